@@ -0,0 +1,232 @@
+#include "Concurrent.h"
+using namespace std;
+
+
+static void deleteTree(ConcurrentNode* node){
+    if(node==nullptr) return;
+    if(!node->isLeaf){
+        deleteTree(node->left.load());
+        deleteTree(node->right.load());
+    }
+    delete node;
+}
+
+static void deleteNode(void* node){
+    delete (ConcurrentNode*)node;
+}
+
+static void deleteSubtree(void* node){
+    deleteTree((ConcurrentNode*)node);
+}
+
+// radius = max(radius, d), against inserts raising it at the same time
+static void raise(atomic<float> &radius, float d){
+    float seen = radius.load(memory_order_relaxed);
+    while(seen<d && !radius.compare_exchange_weak(seen, d, memory_order_release, memory_order_relaxed)) {}
+}
+
+ConcurrentGHT::~ConcurrentGHT(){
+    deleteTree(root.load());
+}
+
+
+// ---------------------- Build ----------------------
+// random pivots, points nearer to pivotA go left; the node is complete before anyone can reach it
+ConcurrentNode* ConcurrentGHT::buildNode(vector<Point> &points, long long &computations, int &pivots, SplitRng &rng){
+    int n = (int)points.size();
+    if(n==0) return nullptr;
+    if(n<=leafSize) return new ConcurrentNode(move(points));
+
+    int idA = rng.below(n);
+    int idB = rng.below(n);
+    while(idA==idB) idB = rng.below(n);
+    vector<Point> leftPartition, rightPartition;
+    float radiusA = 0, radiusB = 0;
+    for(int i=0; i<n; i++){
+        if(i==idA || i==idB) continue;
+        float dA = distance(points[i], points[idA]);
+        float dB = distance(points[i], points[idB]);
+        computations += 2;
+        if(dA<=dB){
+            leftPartition.push_back(points[i]);
+            radiusA = max(radiusA, dA);
+        }
+        else{
+            rightPartition.push_back(points[i]);
+            radiusB = max(radiusB, dB);
+        }
+    }
+    if(leftPartition.empty() && rightPartition.empty()) return new ConcurrentNode(move(points));
+
+    ConcurrentNode* node = new ConcurrentNode(points[idA], points[idB]);
+    node->radiusA.store(radiusA, memory_order_relaxed);
+    node->radiusB.store(radiusB, memory_order_relaxed);
+    pivots += 2;
+    SplitRng leftRng = rng.split();
+    SplitRng rightRng = rng.split();
+    node->left.store(buildNode(leftPartition, computations, pivots, leftRng));
+    node->right.store(buildNode(rightPartition, computations, pivots, rightRng));
+    return node;
+}
+
+// the old tree is retired as a whole, searches that started before the swap finish on it
+void ConcurrentGHT::build(const Point arr[], int n){
+    unique_lock<shared_mutex> excluding(structure);
+    vector<Point> points(arr, arr+n);
+    long long computations = 0;
+    int pivots = 0;
+    SplitRng rng(seed);
+    ConcurrentNode* old = root.exchange(buildNode(points, computations, pivots, rng));
+    if(old) epochs.retire(old, deleteSubtree);
+
+    lock_guard<mutex> guard(statsLock);
+    stats = IndexStats();
+    stats.computationsBuild = computations;
+    stats.pivotCount = pivots;
+    stats.pointCount = n;
+}
+
+
+// ---------------------- Insert ----------------------
+// the point is routed without locks; at the bottom the writer locks the node above the leaf and checks the leaf
+// is still the one it saw, otherwise another writer replaced it first and the point is routed on from there
+void ConcurrentGHT::insert(const Point &p){
+    shared_lock<shared_mutex> inserting(structure);
+    EpochGuard guard(epochs);
+    long long computations = 0;
+    int pivots = 0;
+    SplitRng rng(seed+(unsigned)p.id); // by point rather than by thread, so the splits do not depend on who inserts
+    atomic<ConcurrentNode*>* slot = &root;
+    mutex* lock = &rootLock;
+    while(true){
+        ConcurrentNode* node = slot->load(memory_order_acquire);
+        if(node && !node->isLeaf){
+            float dA = distance(p, node->pivotA);
+            float dB = distance(p, node->pivotB);
+            computations += 2;
+            lock = &node->lock;
+            raise((dA<=dB) ? node->radiusA : node->radiusB, (dA<=dB) ? dA : dB);
+            slot = (dA<=dB) ? &node->left : &node->right;
+            continue;
+        }
+
+        lock_guard<mutex> replacing(*lock);
+        if(slot->load(memory_order_acquire)!=node) continue;
+        vector<Point> points;
+        if(node) points = node->bucket;
+        points.push_back(p);
+        slot->store(buildNode(points, computations, pivots, rng), memory_order_release);
+        if(node) epochs.retire(node, deleteNode);
+        break;
+    }
+
+    lock_guard<mutex> counting(statsLock);
+    stats.computationsBuild += computations;
+    stats.pivotCount += pivots;
+    stats.pointCount++;
+}
+
+void ConcurrentGHT::merge(const MetricIndex &other){
+    vector<Point> incoming;
+    other.collect(incoming);
+    for(const Point &p : incoming){
+        insert(p);
+    }
+}
+
+
+// ---------------------- Search ----------------------
+void ConcurrentGHT::search(const Point &q, ResultSet &result) const{
+    EpochGuard guard(epochs);
+    search(root.load(memory_order_acquire), q, result, 0);
+}
+
+// bound is a lower bound on the distance from q to anything below node, what is left out when the search runs out
+void ConcurrentGHT::search(const ConcurrentNode* node, const Point &q, ResultSet &result, float bound) const{
+    if(node==nullptr) return;
+    if(result.exhausted()){
+        result.leaveOut(bound);
+        return;
+    }
+
+    if(node->isLeaf){
+        for(int i=0; i<(int)node->bucket.size(); i++){
+            if(result.exhausted()){
+                result.leaveOut(bound);
+                return;
+            }
+            float d = distance(q, node->bucket[i]);
+            result.computations++;
+            result.offer(node->bucket[i], d);
+        }
+        return;
+    }
+
+    float dA = distance(q, node->pivotA);
+    float dB = distance(q, node->pivotB);
+    result.computations += 2;
+    result.offer(node->pivotA, dA);
+    result.offer(node->pivotB, dB);
+
+    // same order, hyperplane and covering radius tests as GHTIndex::search
+    const ConcurrentNode* left = node->left.load(memory_order_acquire);
+    const ConcurrentNode* right = node->right.load(memory_order_acquire);
+    float leftBound = max(bound, max((dA-dB)/2, dA-node->radiusA.load(memory_order_acquire)));
+    float rightBound = max(bound, max((dB-dA)/2, dB-node->radiusB.load(memory_order_acquire)));
+    if(dA<=dB){
+        if(leftBound <= result.bound()) search(left, q, result, leftBound);
+        if(rightBound <= result.bound()) search(right, q, result, rightBound);
+    }
+    else{
+        if(rightBound <= result.bound()) search(right, q, result, rightBound);
+        if(leftBound <= result.bound()) search(left, q, result, leftBound);
+    }
+}
+
+static void gatherTree(const ConcurrentNode* node, vector<Point> &out){
+    if(node==nullptr) return;
+    if(node->isLeaf){
+        out.insert(out.end(), node->bucket.begin(), node->bucket.end());
+        return;
+    }
+    out.push_back(node->pivotA);
+    out.push_back(node->pivotB);
+    gatherTree(node->left.load(memory_order_acquire), out);
+    gatherTree(node->right.load(memory_order_acquire), out);
+}
+
+void ConcurrentGHT::collect(vector<Point> &out) const{
+    EpochGuard guard(epochs);
+    gatherTree(root.load(memory_order_acquire), out);
+}
+
+MetricIndex* ConcurrentGHT::clone() const{
+    ConcurrentGHT* copy = new ConcurrentGHT(metricType, leafSize);
+    copy->seed = seed;
+    vector<Point> points;
+    collect(points);
+    copy->build(points.data(), (int)points.size());
+    copy->stats.computationsBuild = stats.computationsBuild;
+    return copy;
+}
+
+
+// ---------------------- Build Report ----------------------
+void ConcurrentGHT::report(BuildReport &report) const{
+    EpochGuard guard(epochs);
+    collectReport(root.load(memory_order_acquire), 0, report);
+}
+
+int ConcurrentGHT::collectReport(const ConcurrentNode* node, int depth, BuildReport &report) const{
+    if(node==nullptr) return 0;
+    if(node->isLeaf){
+        int count = (int)node->bucket.size();
+        report.addLeaf(depth, min(count, N_MAX), sizeof(ConcurrentNode)+node->bucket.capacity()*sizeof(Point));
+        return count;
+    }
+    int leftN = collectReport(node->left.load(memory_order_acquire), depth+1, report);
+    int rightN = collectReport(node->right.load(memory_order_acquire), depth+1, report);
+    float imbalance = (leftN+rightN==0) ? 0 : (float)abs(leftN-rightN)/(leftN+rightN);
+    report.addSplit(depth, 2, 2, imbalance, sizeof(ConcurrentNode));
+    return leftN+rightN+2;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "metric_index.h"
+#include "Epoch.h"
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+
+
+// ---------------------- Structures ----------------------
+// internal nodes are never replaced once published, only their child pointers change and their radii grow; a leaf is
+// never modified, an insert replaces it with a copy holding one more point, or with a subtree once it outgrows leafSize
+struct ConcurrentNode{
+    Point pivotA;
+    Point pivotB;
+    std::atomic<ConcurrentNode*> left{nullptr};
+    std::atomic<ConcurrentNode*> right{nullptr};
+    // covering radii as in TreeNode, raised by an insert on its way down before its point can be reached, so a search
+    // pruning by a radius it read before the raise misses only that point, as if it had run before the insert
+    std::atomic<float> radiusA{0};
+    std::atomic<float> radiusB{0};
+    std::mutex lock; // held by a writer replacing one of the children
+    std::vector<Point> bucket;
+    bool isLeaf;
+
+    ConcurrentNode(const Point &a, const Point &b) : pivotA(a), pivotB(b), isLeaf(false) {}
+    explicit ConcurrentNode(std::vector<Point> points) : bucket(std::move(points)), isLeaf(true) {}
+};
+
+
+// ---------------------- Index ----------------------
+// a random pivoting GHT that keeps answering searches while points are inserted
+// readers take no lock: they enter an epoch and follow the child pointers. A writer routes its point down the
+// hyperplanes, locks only the node above the leaf it reaches and swaps in the new leaf with one atomic store, so
+// writers in different subtrees do not wait for each other. The leaf it replaced is retired to the epoch manager
+// and freed once no reader can still be scanning it
+// build swaps in a whole new tree and waits for the inserts in flight, it is the only operation that excludes them
+class ConcurrentGHT : public MetricIndex{
+public:
+    ConcurrentGHT(int metricType=1, int leafSize=4) : MetricIndex(metricType, leafSize) {}
+    ConcurrentGHT(const ConcurrentGHT&) = delete;
+    ConcurrentGHT& operator=(const ConcurrentGHT&) = delete;
+    ~ConcurrentGHT();
+
+    const char* name() const override{
+        return "Concurrent GHT";
+    }
+
+    void build(const Point arr[], int n) override;
+    void search(const Point &q, ResultSet &result) const override;
+    void report(BuildReport &report) const override;
+    void collect(std::vector<Point> &out) const override;
+    MetricIndex* clone() const override;
+
+    // inserts the points of other one by one
+    void merge(const MetricIndex &other) override;
+
+    // safe to call from any number of threads, alongside each other and alongside search
+    void insert(const Point &p);
+
+    // frees the retired leaves no search can reach any more; inserts also do this as they go
+    void reclaim(){
+        epochs.reclaim();
+    }
+
+    // leaves retired by inserts and not freed yet
+    long long pendingReclamation() const{
+        return epochs.pending();
+    }
+
+private:
+    std::atomic<ConcurrentNode*> root{nullptr};
+    std::mutex rootLock; // held by a writer replacing the root
+    std::shared_mutex structure; // shared by inserts, exclusive for build
+    std::mutex statsLock; // guards stats while inserts run
+    mutable EpochManager epochs;
+
+    ConcurrentNode* buildNode(std::vector<Point> &points, long long &computations, int &pivots, SplitRng &rng);
+    void search(const ConcurrentNode* node, const Point &q, ResultSet &result, float bound) const;
+    int collectReport(const ConcurrentNode* node, int depth, BuildReport &report) const;
+};
@@ -0,0 +1,403 @@
+#include "Disk.h"
+#include <algorithm>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+using namespace std;
+
+
+DiskGHT::DiskGHT(GHTIndex* tree, const string &path) : MetricIndex(tree->metricType, tree->leafSize), tree(tree), path(path) {}
+
+DiskGHT::~DiskGHT(){
+    closeFile();
+    unlink(path.c_str());
+}
+
+DiskGHT::Block::~Block(){
+    free(points);
+}
+
+static Point* allocatePages(int pages){
+    void* buffer = nullptr;
+    if(posix_memalign(&buffer, DISK_PAGE, (size_t)pages*DISK_PAGE)!=0) throw bad_alloc();
+    return (Point*)buffer;
+}
+
+
+// ---------------------- Build ----------------------
+// the tree is built in memory as usual, then its internal nodes are copied and its leaves written out in depth-first order
+void DiskGHT::build(const Point arr[], int n){
+    closeFile();
+    nodes.clear();
+    leaves.clear();
+    tree->seed = seed;
+    tree->build(arr, n);
+    stats = tree->stats;
+
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd<0) throw runtime_error("DiskGHT::build: cannot create "+path);
+    try{
+        if(tree->root) addNode(tree->root, false, tree->inheritsPivots());
+    }
+    catch(...){
+        // left empty, with no descriptor open
+        close(fd);
+        fd = -1;
+        nodes.clear();
+        leaves.clear();
+        stats = IndexStats();
+        throw;
+    }
+    fsync(fd);
+    close(fd);
+    fd = -1;
+    tree->build(nullptr, 0);
+    openFile();
+}
+
+int DiskGHT::addNode(const TreeNode* node, bool inherited, bool reusing){
+    int at = (int)nodes.size();
+    nodes.push_back(DiskNode());
+    nodes[at].left = nodes[at].right = nodes[at].leaf = -1;
+    nodes[at].inherited = inherited;
+    if(node->isLeaf){
+        nodes[at].leaf = (int)leaves.size();
+        writeLeaf(node->bucket, node->bucketSize);
+        return at;
+    }
+    nodes[at].pivotA = node->pivotA;
+    nodes[at].pivotB = node->pivotB;
+    nodes[at].radiusA = node->radiusA;
+    nodes[at].radiusB = node->radiusB;
+    nodes[at].ball = node->ball;
+    nodes[at].innerRadius = node->innerRadius;
+    if(node->left){
+        int left = addNode(node->left, reusing, reusing);
+        nodes[at].left = left;
+    }
+    if(node->right){
+        int right = addNode(node->right, reusing, reusing);
+        nodes[at].right = right;
+    }
+    return at;
+}
+
+void DiskGHT::writeLeaf(const Point arr[], int count){
+    DiskLeaf leaf;
+    leaf.offset = leaves.empty() ? 0 : leaves.back().offset+(long long)leaves.back().pages*DISK_PAGE;
+    leaf.count = count;
+    leaf.pages = max(1, (int)((count*sizeof(Point)+DISK_PAGE-1)/DISK_PAGE));
+    leaves.push_back(leaf);
+
+    size_t bytes = (size_t)leaf.pages*DISK_PAGE;
+    Point* buffer = allocatePages(leaf.pages);
+    memset((void*)buffer, 0, bytes);
+    memcpy((void*)buffer, arr, count*sizeof(Point));
+    ssize_t written = pwrite(fd, buffer, bytes, leaf.offset);
+    free(buffer);
+    if(written!=(ssize_t)bytes) throw runtime_error("DiskGHT::build: cannot write "+path);
+}
+
+// opens the written file for reading and starts the I/O threads
+void DiskGHT::openFile(){
+#ifdef O_DIRECT
+    if(directIO) fd = open(path.c_str(), O_RDONLY | O_DIRECT);
+#endif
+    if(fd<0) fd = open(path.c_str(), O_RDONLY); // e.g. tmpfs refuses O_DIRECT
+    if(fd<0) throw runtime_error("DiskGHT::build: cannot open "+path);
+    stopping = false;
+    for(int t=0; t<ioThreads; t++){
+        readers.emplace_back(&DiskGHT::readLoop, this);
+    }
+}
+
+void DiskGHT::closeFile(){
+    {
+        lock_guard<mutex> guard(cacheLock);
+        stopping = true;
+    }
+    work.notify_all();
+    for(thread &t : readers) t.join();
+    readers.clear();
+    requests.clear();
+    dropCache();
+    if(fd>=0) close(fd);
+    fd = -1;
+}
+
+long long DiskGHT::fileBytes() const{
+    if(leaves.empty()) return 0;
+    return leaves.back().offset+(long long)leaves.back().pages*DISK_PAGE;
+}
+
+
+// ---------------------- Block Cache ----------------------
+void DiskGHT::readLoop(){
+    unique_lock<mutex> guard(cacheLock);
+    while(true){
+        work.wait(guard, [&]{ return stopping || !requests.empty(); });
+        if(stopping) return;
+        int leaf = requests.front().first;
+        shared_ptr<Block> block = requests.front().second;
+        requests.pop_front();
+        guard.unlock();
+
+        const DiskLeaf &where = leaves[leaf];
+        size_t bytes = (size_t)where.pages*DISK_PAGE;
+        Point* buffer = nullptr;
+        size_t done = 0;
+        try{
+            buffer = allocatePages(where.pages);
+        }
+        catch(const bad_alloc&){}
+        while(buffer && done<bytes){
+            ssize_t got = pread(fd, (char*)buffer+done, bytes-done, where.offset+done);
+            if(got<=0) break;
+            done += got;
+        }
+        blockReads++;
+        if(done<bytes){
+            free(buffer);
+            buffer = nullptr;
+        }
+
+        guard.lock();
+        block->points = buffer;
+        block->failed = !buffer;
+        block->ready = true;
+        // dropCache may have let go of the block meanwhile, then it only lives as long as the searches waiting on it
+        auto found = cached.find(leaf);
+        if(found!=cached.end() && found->second==block && block->failed){
+            cached.erase(found); // the searches waiting on it throw, the next one to need the leaf reads it again
+        }
+        else if(found!=cached.end() && found->second==block){
+            recentLeaves.push_front(leaf);
+            block->recent = recentLeaves.begin();
+            cachedBytes += bytes;
+            evict();
+        }
+        loaded.notify_all();
+    }
+}
+
+// least recently used blocks go first, all but the block used last and those pinned; a search still scanning an
+// evicted block keeps its own reference
+void DiskGHT::evict() const{
+    auto at = recentLeaves.end();
+    while(cachedBytes>cacheBudget && at!=recentLeaves.begin()){
+        --at;
+        if(at==recentLeaves.begin()) break;
+        if(cached[*at]->pins>0) continue;
+        cachedBytes -= (long long)leaves[*at].pages*DISK_PAGE;
+        cached.erase(*at);
+        at = recentLeaves.erase(at);
+    }
+}
+
+void DiskGHT::request(int leaf) const{
+    shared_ptr<Block> block = make_shared<Block>();
+    cached[leaf] = block;
+    requests.push_back({leaf, block});
+    work.notify_one();
+}
+
+shared_ptr<DiskGHT::Block> DiskGHT::prefetch(int leaf) const{
+    lock_guard<mutex> guard(cacheLock);
+    if(cached.find(leaf)==cached.end()) request(leaf);
+    shared_ptr<Block> block = cached[leaf];
+    block->pins++;
+    return block;
+}
+
+// a block that is no longer in the cache (failed, or let go by dropCache) is only kept alive by block itself
+void DiskGHT::unpin(const shared_ptr<Block> &block) const{
+    lock_guard<mutex> guard(cacheLock);
+    block->pins--;
+    evict();
+}
+
+// the block of the leaf, read first if it is not cached; throws runtime_error when it cannot be read
+shared_ptr<DiskGHT::Block> DiskGHT::fetch(int leaf) const{
+    unique_lock<mutex> guard(cacheLock);
+    auto found = cached.find(leaf);
+    if(found==cached.end()) request(leaf);
+    shared_ptr<Block> block = cached[leaf];
+    if(block->ready){
+        cacheHits++;
+        recentLeaves.splice(recentLeaves.begin(), recentLeaves, block->recent);
+    }
+    loaded.wait(guard, [&]{ return block->ready; });
+    if(block->failed) throw runtime_error("DiskGHT: cannot read a leaf block of "+path);
+    return block;
+}
+
+void DiskGHT::dropCache(){
+    lock_guard<mutex> guard(cacheLock);
+    cached.clear();
+    recentLeaves.clear();
+    cachedBytes = 0;
+}
+
+
+// ---------------------- Search ----------------------
+// entries are explored nearest lower bound first; a side of a node cannot hold anything nearer to q than
+// (d(q,pFar)-d(q,pNear))/2, the same bound the hyperplane test of GHTIndex::search uses
+struct DiskEntry{
+    float lowerBound;
+    int at;
+    float knownDA; // d(q, pivotA) when pivotA is inherited, -1 otherwise
+};
+
+static bool fartherEntry(const DiskEntry &a, const DiskEntry &b){
+    return a.lowerBound>b.lowerBound;
+}
+
+void DiskGHT::search(const Point &q, ResultSet &result) const{
+    if(nodes.empty()) return;
+    vector<DiskEntry> heap; // min-heap on lowerBound
+    vector<DiskEntry> ahead;
+    vector<pair<int, shared_ptr<Block>>> requested; // leaves prefetched for this query and not scanned yet, pinned
+    auto isRequested = [&](int leaf){
+        for(const auto &pinned : requested){
+            if(pinned.first==leaf) return true;
+        }
+        return false;
+    };
+    // on every way out, fetch throwing included, the leaves still requested are let go
+    struct Unpinning{
+        const DiskGHT* index;
+        vector<pair<int, shared_ptr<Block>>> &requested;
+        ~Unpinning(){
+            for(const auto &pinned : requested) index->unpin(pinned.second);
+        }
+    } unpinning{this, requested};
+    heap.push_back({0, 0, -1});
+
+    while(!heap.empty() && !result.exhausted()){
+        pop_heap(heap.begin(), heap.end(), fartherEntry);
+        DiskEntry entry = heap.back();
+        heap.pop_back();
+        if(entry.lowerBound>result.bound()) break;
+        const DiskNode &node = nodes[entry.at];
+
+        if(node.leaf>=0){
+            // request the nearest leaves still waiting, then scan this one while they are read
+            // leaves requested earlier and not scanned yet count against readAhead and against what the cache holds
+            ahead.clear();
+            for(const DiskEntry &other : heap){
+                int leaf = nodes[other.at].leaf;
+                if(leaf>=0 && other.lowerBound<=result.bound() && !isRequested(leaf)) ahead.push_back(other);
+            }
+            long long room = cacheBudget/((long long)leaves[node.leaf].pages*DISK_PAGE)-1;
+            long long wanted = min((long long)readAhead-1, room)-(long long)requested.size()+(isRequested(node.leaf) ? 1 : 0);
+            wanted = max(0LL, min(wanted, (long long)ahead.size()));
+            partial_sort(ahead.begin(), ahead.begin()+wanted, ahead.end(), [](const DiskEntry &a, const DiskEntry &b){ return a.lowerBound<b.lowerBound; });
+            for(int i=0; i<wanted; i++){
+                int leaf = nodes[ahead[i].at].leaf;
+                requested.push_back({leaf, prefetch(leaf)});
+            }
+
+            shared_ptr<Block> block = fetch(node.leaf);
+            for(auto at=requested.begin(); at!=requested.end(); ++at){
+                if(at->first==node.leaf){
+                    unpin(at->second); // fetch made it the block used last
+                    requested.erase(at);
+                    break;
+                }
+            }
+            for(int i=0; i<leaves[node.leaf].count; i++){
+                if(result.exhausted()){
+                    result.leaveOut(entry.lowerBound);
+                    break;
+                }
+                float d = distance(q, block->points[i]);
+                result.computations++;
+                result.offer(block->points[i], d);
+            }
+            continue;
+        }
+
+        float dA = entry.knownDA;
+        if(dA<0){
+            dA = distance(q, node.pivotA);
+            result.computations++;
+            result.offer(node.pivotA, dA);
+        }
+        float dB = dA;
+        if(!node.ball){
+            dB = distance(q, node.pivotB);
+            result.computations++;
+            result.offer(node.pivotB, dB);
+        }
+
+        float boundA, boundB;
+        childBounds(node, dA, dB, boundA, boundB);
+        boundA = max(entry.lowerBound, boundA);
+        boundB = max(entry.lowerBound, boundB);
+        if(node.left>=0 && boundA<=result.bound()){
+            heap.push_back({boundA, node.left, nodes[node.left].inherited ? dA : -1});
+            push_heap(heap.begin(), heap.end(), fartherEntry);
+        }
+        if(node.right>=0 && boundB<=result.bound()){
+            heap.push_back({boundB, node.right, nodes[node.right].inherited ? dB : -1});
+            push_heap(heap.begin(), heap.end(), fartherEntry);
+        }
+    }
+    // out of budget or time, the nearest entry still waiting bounds everything left out
+    if(!heap.empty() && result.exhausted()) result.leaveOut(heap.front().lowerBound);
+}
+
+void DiskGHT::collect(vector<Point> &out) const{
+    for(const DiskNode &node : nodes){
+        if(node.leaf>=0){
+            shared_ptr<Block> block = fetch(node.leaf);
+            out.insert(out.end(), block->points, block->points+leaves[node.leaf].count);
+        }
+        else{
+            if(!node.inherited) out.push_back(node.pivotA);
+            if(!node.ball) out.push_back(node.pivotB);
+        }
+    }
+}
+
+// the file of the copy is made by mkstemp, so clones taken by several threads or forked workers never share one
+MetricIndex* DiskGHT::clone() const{
+    string name = path+".XXXXXX";
+    int made = mkstemp(&name[0]);
+    if(made<0) throw runtime_error("DiskGHT::clone: cannot create a file next to "+path);
+    close(made);
+    DiskGHT* copy = new DiskGHT((GHTIndex*)tree->clone(), name);
+    copy->cacheBudget = cacheBudget;
+    copy->readAhead = readAhead;
+    copy->ioThreads = ioThreads;
+    copy->directIO = directIO;
+    vector<Point> points;
+    collect(points);
+    copy->build(points.data(), (int)points.size());
+    copy->stats = stats;
+    return copy;
+}
+
+
+// ---------------------- Build Report ----------------------
+// memoryBytes counts what stays in memory, the leaf blocks are on disk
+void DiskGHT::report(BuildReport &report) const{
+    if(!nodes.empty()) collectReport(0, 0, report);
+}
+
+int DiskGHT::collectReport(int at, int depth, BuildReport &report) const{
+    if(at<0) return 0;
+    const DiskNode &node = nodes[at];
+    if(node.leaf>=0){
+        report.addLeaf(depth, leaves[node.leaf].count, sizeof(DiskNode)+sizeof(DiskLeaf));
+        return leaves[node.leaf].count;
+    }
+    int leftN = collectReport(node.left, depth+1, report);
+    int rightN = collectReport(node.right, depth+1, report);
+    int stored = (node.inherited ? 0 : 1)+(node.ball ? 0 : 1);
+    float imbalance = (leftN+rightN==0) ? 0 : (float)abs(leftN-rightN)/(leftN+rightN);
+    report.addSplit(depth, 2, stored, imbalance, sizeof(DiskNode));
+    return leftN+rightN+stored;
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include "GHT.h"
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <deque>
+#include <list>
+#include <unordered_map>
+
+#define DISK_PAGE 4096 // leaf blocks start on and fill whole pages of this many bytes
+
+
+// ---------------------- Structures ----------------------
+// the in-memory part of a disk-resident GHT: the pivots of every internal node, and where each leaf's block is
+struct DiskNode{
+    Point pivotA;
+    Point pivotB;
+    int left, right; // positions in nodes, -1 for no child
+    int leaf; // position in leaves, -1 for internal nodes
+    float radiusA, radiusB; // covering radii of the children, as in TreeNode
+    bool ball; // a vantage point split, as in TreeNode
+    float innerRadius;
+    bool inherited; // pivotA is the parent's pivot (below the root of a monotonous bisector tree)
+};
+
+struct DiskLeaf{
+    long long offset; // of the block in the file, a multiple of DISK_PAGE
+    int count; // points in the block
+    int pages;
+};
+
+
+// ---------------------- Index ----------------------
+// a GHT whose leaf buckets live in a file as page-aligned blocks, read with pread by a pool of I/O threads into a
+// cache of at most cacheBudget bytes. Search is best-first over the in-memory nodes: a leaf is read when it is the
+// nearest thing left to explore, and the next readAhead-1 nearest leaves are requested along with it, so their
+// reads overlap with the scan instead of each stalling the query in turn. A block requested ahead stays in the cache
+// until its search scans it or finds it no longer needed, even past cacheBudget, so no read is wasted on a block
+// evicted before its scan
+// the file is written by build and removed with the index; a block that cannot be read makes search (and collect)
+// throw runtime_error rather than scan a partial block, and is read afresh by the next search that needs it
+class DiskGHT : public MetricIndex{
+public:
+    long long cacheBudget = 64LL<<20; // bytes of leaf blocks kept in memory
+    int readAhead = 4; // leaf reads in flight per query
+    int ioThreads = 4; // takes effect at the next build
+    bool directIO = true; // bypass the OS page cache with O_DIRECT where the file system allows it
+
+    std::vector<DiskNode> nodes; // nodes[0] is the root
+    std::vector<DiskLeaf> leaves;
+
+    mutable std::atomic<long long> blockReads{0}; // blocks read from the file
+    mutable std::atomic<long long> cacheHits{0}; // blocks a search found in the cache
+
+    // tree (owned) picks the pivots at build time, its nodes are freed once the file is written
+    DiskGHT(GHTIndex* tree, const std::string &path);
+    DiskGHT(const DiskGHT&) = delete;
+    DiskGHT& operator=(const DiskGHT&) = delete;
+    ~DiskGHT();
+
+    const char* name() const override{
+        return "Disk GHT";
+    }
+
+    void build(const Point arr[], int n) override;
+    void search(const Point &q, ResultSet &result) const override;
+    void report(BuildReport &report) const override;
+    void collect(std::vector<Point> &out) const override;
+
+    // another disk index with the same settings over the same points, in a file of its own named path+".XXXXXX"
+    MetricIndex* clone() const override;
+
+    // empties the cache, so the next searches start cold
+    void dropCache();
+
+    // bytes of the leaf file
+    long long fileBytes() const;
+
+private:
+    std::unique_ptr<GHTIndex> tree;
+    std::string path;
+    int fd = -1;
+
+    // a leaf's block, shared between the cache and the searches scanning it
+    struct Block{
+        Point* points = nullptr; // page-aligned
+        bool ready = false;
+        bool failed = false; // ready, but the read failed or came up short; points is null
+        int pins = 0; // searches that requested the block ahead and have not scanned or dropped it; it is not evicted
+        std::list<int>::iterator recent;
+        ~Block();
+    };
+    mutable std::mutex cacheLock; // guards everything below
+    mutable std::condition_variable loaded; // a block became ready
+    mutable std::condition_variable work; // a read was requested, or stopping is set
+    mutable std::unordered_map<int, std::shared_ptr<Block>> cached;
+    mutable std::list<int> recentLeaves; // ready blocks, most recently used first
+    mutable long long cachedBytes = 0;
+    mutable std::deque<std::pair<int, std::shared_ptr<Block>>> requests;
+    bool stopping = false;
+    std::vector<std::thread> readers;
+
+    int addNode(const TreeNode* node, bool inherited, bool reusing);
+    void writeLeaf(const Point arr[], int count);
+    void openFile();
+    void closeFile();
+    void readLoop();
+    void request(int leaf) const; // call with cacheLock held
+    void evict() const; // call with cacheLock held
+    std::shared_ptr<Block> fetch(int leaf) const;
+    std::shared_ptr<Block> prefetch(int leaf) const; // the block comes back pinned
+    void unpin(const std::shared_ptr<Block> &block) const;
+    int collectReport(int at, int depth, BuildReport &report) const;
+};
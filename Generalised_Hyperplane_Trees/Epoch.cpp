@@ -0,0 +1,65 @@
+#include "Epoch.h"
+#include <functional>
+#include <thread>
+using namespace std;
+
+
+EpochManager::~EpochManager(){
+    for(int e=0; e<3; e++){
+        for(const Retired &r : garbage[e]) r.destroy(r.p);
+    }
+}
+
+EpochManager::Slot& EpochManager::mySlot(){
+    static thread_local size_t at = hash<thread::id>()(this_thread::get_id())%EPOCH_SLOTS;
+    return slots[at];
+}
+
+
+// ---------------------- Readers ----------------------
+// the epoch is read again after the counter is raised: if it moved in between, a writer may have checked the
+// counter before it was raised and freed what this reader is about to see, so the reader retries in the new epoch
+long long EpochManager::enter(){
+    Slot &slot = mySlot();
+    while(true){
+        long long e = epoch.load();
+        slot.readers[e%3]++;
+        if(epoch.load()==e) return e;
+        slot.readers[e%3]--;
+    }
+}
+
+void EpochManager::leave(long long e){
+    mySlot().readers[e%3]--;
+}
+
+
+// ---------------------- Writers ----------------------
+void EpochManager::retire(void* p, void (*destroy)(void*)){
+    lock_guard<mutex> guard(garbageLock);
+    garbage[epoch.load()%3].push_back({p, destroy});
+    tryAdvance();
+}
+
+// from e to e+1 once no reader is left in e-1; what was retired in e-1 is then out of every reader's reach
+void EpochManager::tryAdvance(){
+    long long e = epoch.load();
+    int previous = (int)((e+2)%3);
+    for(const Slot &slot : slots){
+        if(slot.readers[previous].load()!=0) return;
+    }
+    vector<Retired> freeing;
+    freeing.swap(garbage[previous]);
+    epoch.store(e+1);
+    for(const Retired &r : freeing) r.destroy(r.p);
+}
+
+void EpochManager::reclaim(){
+    lock_guard<mutex> guard(garbageLock);
+    for(int i=0; i<3; i++) tryAdvance();
+}
+
+long long EpochManager::pending() const{
+    lock_guard<mutex> guard(garbageLock);
+    return (long long)(garbage[0].size()+garbage[1].size()+garbage[2].size());
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#define EPOCH_SLOTS 64 // reader counters, threads hash onto them so readers rarely share a cache line
+
+
+// ---------------------- Epoch-Based Reclamation ----------------------
+// lets writers unlink nodes that lock-free readers may still be traversing, and frees them once no reader can
+// hold them any more. A reader announces the global epoch it entered in; a node unlinked during epoch e is only
+// freed when the epoch has moved to e+2, and the epoch only moves from e to e+1 once no reader is left in e-1,
+// so every reader that could have seen the node has left by then. Three epochs are live at any time, and each
+// slot counts its readers per epoch modulo 3
+class EpochManager{
+public:
+    EpochManager() = default;
+    EpochManager(const EpochManager&) = delete;
+    EpochManager& operator=(const EpochManager&) = delete;
+    ~EpochManager(); // frees everything still retired, no reader may be inside
+
+    // returns the epoch to hand back to leave
+    long long enter();
+    void leave(long long epoch);
+
+    // p is freed by destroy(p) once no reader can reach it; call after p is unlinked
+    void retire(void* p, void (*destroy)(void*));
+
+    // frees what no reader can reach any more without waiting for the next retire, everything when no reader is inside
+    void reclaim();
+
+    // nodes retired and not freed yet
+    long long pending() const;
+
+private:
+    struct alignas(64) Slot{
+        std::atomic<int> readers[3] = {};
+    };
+    struct Retired{
+        void* p;
+        void (*destroy)(void*);
+    };
+
+    std::atomic<long long> epoch{0};
+    Slot slots[EPOCH_SLOTS];
+    mutable std::mutex garbageLock; // guards garbage
+    std::vector<Retired> garbage[3]; // garbage[e%3] was retired during epoch e
+
+    Slot& mySlot();
+    void tryAdvance(); // call with garbageLock held
+};
+
+// a reader's stay in an epoch, for the scope of the guard
+class EpochGuard{
+public:
+    explicit EpochGuard(EpochManager &epochs) : epochs(epochs), epoch(epochs.enter()) {}
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+    ~EpochGuard(){
+        epochs.leave(epoch);
+    }
+
+private:
+    EpochManager &epochs;
+    long long epoch;
+};
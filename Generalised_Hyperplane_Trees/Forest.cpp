@@ -0,0 +1,64 @@
+#include "Forest.h"
+using namespace std;
+
+
+Forest::Forest(const Forest &other) : MetricIndex(other){
+    forestMode = other.forestMode;
+    treeBudget = other.treeBudget;
+    for(MetricIndex* tree : other.trees) trees.push_back(tree->clone());
+}
+
+Forest::~Forest(){
+    for(MetricIndex* tree : trees) delete tree;
+}
+
+void Forest::add(MetricIndex* tree){
+    trees.push_back(tree);
+}
+
+// ---------------------- Build ----------------------
+void Forest::build(const Point arr[], int n){
+    stats = IndexStats();
+    for(int t=0; t<(int)trees.size(); t++){
+        trees[t]->seed = seed+t;
+        trees[t]->build(arr, n);
+        stats.computationsBuild += trees[t]->stats.computationsBuild;
+        stats.pivotCount += trees[t]->stats.pivotCount;
+        stats.resampleCount += trees[t]->stats.resampleCount;
+    }
+    stats.pointCount = n;
+}
+
+// ---------------------- Search ----------------------
+void Forest::search(const Point &q, ResultSet &result) const{
+    if(trees.empty()) return;
+    long long callerBudget = result.budget;
+    bool callerDistinct = result.distinct;
+    result.distinct = true; // every tree holds every point
+    // a point no tree reached was left out by each of them, so it is as far as the largest of their bounds
+    float unexplored = 0;
+    for(MetricIndex* tree : trees){
+        result.budget = result.computations+treeBudget;
+        if(callerBudget>=0) result.budget = min(result.budget, callerBudget);
+        result.unexplored = numeric_limits<float>::infinity();
+        tree->search(q, result);
+        unexplored = max(unexplored, result.unexplored);
+    }
+    result.budget = callerBudget;
+    result.unexplored = unexplored;
+    if(forestMode==0){
+        result.unexplored = numeric_limits<float>::infinity();
+        trees[0]->search(q, result);
+        result.unexplored = max(unexplored, result.unexplored);
+    }
+    result.distinct = callerDistinct;
+}
+
+void Forest::collect(vector<Point> &out) const{
+    if(!trees.empty()) trees[0]->collect(out);
+}
+
+// ---------------------- Build Report ----------------------
+void Forest::report(BuildReport &report) const{
+    for(MetricIndex* tree : trees) tree->report(report);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "metric_index.h"
+
+
+// ---------------------- Forest ----------------------
+// several independently built trees over the same points, queried together with one shared bound
+// the trees may be any mix of variants (e.g. random pivoting GHTs next to a GNAT) as long as they use the same metric
+class Forest : public MetricIndex{
+public:
+    // 0 - exact: every tree first gets a budgeted search, then the first tree is searched in full
+    //     starting from the bound they found; any one tree holds every point, so the answer is exact
+    // 1 - approximate: only the budgeted searches
+    int forestMode = 0;
+    long long treeBudget = 100; // distance computations per tree in the budgeted searches
+
+    std::vector<MetricIndex*> trees; // owned by the forest
+
+    Forest(int metricType=1) : MetricIndex(metricType, 0) {}
+    Forest(const Forest &other); // deep copy, every tree is cloned
+    Forest& operator=(const Forest&) = delete;
+    ~Forest();
+
+    const char* name() const override{
+        return "Forest";
+    }
+
+    // takes ownership of tree; tree t is built with seed seed+t, so randomised trees get different pivots
+    void add(MetricIndex* tree);
+
+    void build(const Point arr[], int n) override;
+    void search(const Point &q, ResultSet &result) const override;
+    void report(BuildReport &report) const override;
+
+    MetricIndex* clone() const override{
+        return new Forest(*this);
+    }
+
+    // every tree holds every point, so the first tree's are the forest's
+    void collect(std::vector<Point> &out) const override;
+};
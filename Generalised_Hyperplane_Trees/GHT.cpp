@@ -0,0 +1,729 @@
+#include "GHT.h"
+#include <stdexcept>
+#include <queue>
+#include <unordered_map>
+using namespace std;
+
+
+// ---------------------- Build ----------------------
+// 0 for an even split, 1 when every point lands on the same side
+static float splitImbalance(int leftN, int rightN){
+    if(leftN+rightN==0) return 0;
+    return (float)(leftN>rightN ? leftN-rightN : rightN-leftN)/(leftN+rightN);
+}
+
+// Recursively delete tree (important to avoid memory leaks)
+static void deleteTree(TreeNode* node){
+    if(node==nullptr) return;
+    if(!node->isLeaf){
+        deleteTree(node->left);
+        deleteTree(node->right);
+    }
+    delete node;
+}
+
+static TreeNode* copyTree(const TreeNode* node){
+    if(node==nullptr) return nullptr;
+    TreeNode* copy = new TreeNode(*node);
+    if(!node->isLeaf){
+        copy->left = copyTree(node->left);
+        copy->right = copyTree(node->right);
+    }
+    return copy;
+}
+
+// pivots an internal node stores itself, a vantage point split has only pivotA
+static int storedPivots(const TreeNode* node, bool inherited){
+    return (inherited ? 0 : 1)+(node->ball ? 0 : 1);
+}
+
+// appends the points stored in the subtree to out, returns the pivots among them
+// inherited - the node's pivotA belongs to an ancestor, reusing - the same holds for every node below it
+static int gatherTree(const TreeNode* node, bool inherited, bool reusing, vector<Point> &out){
+    if(node==nullptr) return 0;
+    if(node->isLeaf){
+        out.insert(out.end(), node->bucket, node->bucket+node->bucketSize);
+        return 0;
+    }
+    if(!inherited) out.push_back(node->pivotA);
+    if(!node->ball) out.push_back(node->pivotB);
+    return storedPivots(node, inherited)+gatherTree(node->left, reusing, reusing, out)+gatherTree(node->right, reusing, reusing, out);
+}
+
+// bytes held by the nodes of the subtree
+static long long treeBytes(const TreeNode* node){
+    if(node==nullptr) return 0;
+    if(node->isLeaf) return node->bytes();
+    return node->bytes()+treeBytes(node->left)+treeBytes(node->right);
+}
+
+// points stored in the subtree, without computing any distance
+static int treeSize(const TreeNode* node, bool inherited, bool reusing){
+    if(node==nullptr) return 0;
+    if(node->isLeaf) return node->bucketSize;
+    return storedPivots(node, inherited)+treeSize(node->left, reusing, reusing)+treeSize(node->right, reusing, reusing);
+}
+
+GHTIndex::GHTIndex(const GHTIndex &other) : MetricIndex(other){
+    maxImbalance = other.maxImbalance;
+    maxResamples = other.maxResamples;
+    layoutOrder = other.layoutOrder;
+    batchGroup = other.batchGroup;
+    splitRule = other.splitRule;
+    levelSplits = other.levelSplits;
+    reusesPivots = other.reusesPivots;
+    meter = other.meter;
+    root = copyTree(other.root);
+    flatNodes = other.flatNodes;
+    flatPoints = other.flatPoints;
+    flatKeys = other.flatKeys;
+    flatHeight = other.flatHeight;
+}
+
+GHTIndex::~GHTIndex(){
+    deleteTree(root);
+}
+
+void GHTIndex::build(const Point arr[], int n){
+    if(n>N_MAX) throw length_error("GHTIndex::build: more points than N_MAX");
+    relayout(0);
+    deleteCounted(root);
+    root = nullptr;
+    stats = IndexStats();
+    meter = MemoryMeter();
+    meter.budget = memoryBudget;
+    SplitRng rng(seed);
+    root = buildFrom(arr, n, nullptr, nullptr, 0, rng);
+    try{
+        relayout(layoutOrder);
+    }
+    catch(...){ // the laid out copy did not fit either, an index over budget is left empty
+        deleteCounted(root);
+        root = nullptr;
+        stats = IndexStats();
+        throw;
+    }
+    stats.pointCount = n;
+    stats.memoryBytes = meter.live;
+    stats.peakBuildBytes = meter.peak;
+}
+
+TreeNode* GHTIndex::newLeaf(const Point arr[], const float keys[], int n){
+    meter.charge(sizeof(TreeNode)+(long long)n*(sizeof(Point)+(keys ? sizeof(float) : 0)));
+    TreeNode* node = new TreeNode(arr, n);
+    if(keys){
+        // insertion sort, a leaf holds a handful of points
+        node->keys = new float[n];
+        for(int i=0; i<n; i++){
+            int at = i;
+            while(at>0 && node->keys[at-1]>keys[i]){
+                node->keys[at] = node->keys[at-1];
+                node->bucket[at] = node->bucket[at-1];
+                at--;
+            }
+            node->keys[at] = keys[i];
+            node->bucket[at] = arr[i];
+        }
+    }
+    return node;
+}
+
+void GHTIndex::deleteCounted(TreeNode* node){
+    meter.release(treeBytes(node));
+    deleteTree(node);
+}
+
+TreeNode* GHTIndex::buildFrom(const Point arr[], int n, const Point* reused, const Point* sidePivot, int depth, SplitRng &rng){
+    MemoryCharge reserved(meter, (long long)n*(2*sizeof(Point)+4*sizeof(float)));
+    scratch.points.assign(arr, arr+n);
+    scratch.spare.resize(n);
+    scratch.side.resize(n);
+    scratch.distA.resize(n);
+    scratch.distB.resize(n);
+    scratch.ranked.resize(n);
+    // a subtree small enough to be a leaf takes its keys from here, a larger one's leaves from the splits below it
+    bool known = sidePivot && n<=leafSize;
+    if(known){
+        for(int i=0; i<n; i++){
+            scratch.side[i] = distance(arr[i], *sidePivot);
+            stats.computationsBuild++;
+        }
+    }
+    TreeNode* node;
+    try{
+        node = buildGHT(0, n, reused, known, depth, rng);
+    }
+    catch(...){
+        scratch = BuildScratch();
+        throw;
+    }
+    scratch = BuildScratch();
+    return node;
+}
+
+// the median of dist over the points other than skip, ranked is scratch for n values
+static float medianDistance(const float dist[], int n, int skip, float ranked[]){
+    int count = 0;
+    for(int i=0; i<n; i++){
+        if(i!=skip) ranked[count++] = dist[i];
+    }
+    nth_element(ranked, ranked+(count-1)/2, ranked+count);
+    return ranked[(count-1)/2];
+}
+
+TreeNode* GHTIndex::buildGHT(int first, int n, const Point* reused, bool known, int depth, SplitRng &rng){
+    if(n<=0) return nullptr;
+    Point* arr = &scratch.points[first];
+    if(n<=leafSize) return newLeaf(arr, known ? &scratch.side[first] : nullptr, n);
+
+    int idA, idB;
+    Point pA, pB;
+    int rule = (depth<(int)levelSplits.size()) ? levelSplits[depth] : splitRule;
+    if(reusesPivots) rule = 0;
+    bool ball = false;
+    float median = 0;
+
+    // distances to the pivots, then each point's distance to the pivot on its side
+    float* distA = &scratch.distA[first];
+    float* distB = &scratch.distB[first];
+    float* side = &scratch.side[first];
+    int leftN, rightN; // sizes of the partitions
+    auto goesLeft = [&](int i){ // points nearer to pA go to left paritition, rest go to right
+        return ball ? distA[i]<=median : distA[i]<=distB[i];
+    };
+
+    for(int attempt=0; ; attempt++){
+        choosePivots(arr, n, reused, idA, idB, rng);
+        pA = (idA<0) ? *reused : arr[idA]; // pivots for the current TreeNode
+        pB = arr[idB];
+
+        // an inherited pivot's distances come from the parent; a vantage point split needs pA's only, and there
+        // pB is a point like any other
+        for(int i=0; i<n; i++){
+            if(i==idA || (rule==0 && i==idB)) continue;
+            if(idA<0 && known) distA[i] = side[i];
+            else{
+                distA[i] = distance(arr[i], pA);
+                stats.computationsBuild++;
+            }
+            if(rule!=1 && i!=idB){
+                distB[i] = distance(arr[i], pB);
+                stats.computationsBuild++;
+            }
+        }
+        if(rule!=0) median = medianDistance(distA, n, idA, &scratch.ranked[first]);
+        ball = rule==1;
+
+        // the split whose points lie farther from its boundary on average prunes more queries that start near them:
+        // d(p,pA) - d(p,pB) over 2 from the hyperplane, |d(p,pA) - median| from the vantage point's sphere
+        if(rule==2){
+            double plane = 0, sphere = 0;
+            int planeLeft = 0, sphereLeft = 0, count = 0;
+            for(int i=0; i<n; i++){
+                if(i==idA || i==idB) continue;
+                plane += fabsf(distA[i]-distB[i])/2;
+                sphere += fabsf(distA[i]-median);
+                if(distA[i]<=distB[i]) planeLeft++;
+                if(distA[i]<=median) sphereLeft++;
+                count++;
+            }
+            plane *= 1-splitImbalance(planeLeft, count-planeLeft);
+            sphere *= 1-splitImbalance(sphereLeft, count-sphereLeft);
+            ball = sphere>plane;
+        }
+
+        leftN = 0, rightN = 0;
+        for(int i=0; i<n; i++){
+            if(i==idA || (!ball && i==idB)) continue; // skip the pivots while partitioning
+            if(goesLeft(i)) leftN++;
+            else rightN++;
+        }
+
+        // small partitions are close to leaves anyway, so their balance is not worth extra distance computations
+        if(!randomPivots() || leftN+rightN<=2*leafSize || attempt>=maxResamples) break;
+        if(splitImbalance(leftN, rightN)<=maxImbalance) break;
+        stats.resampleCount++;
+    }
+
+    if(leftN+rightN==0) return newLeaf(arr, known ? side : nullptr, n); // if both partitions are empty (very rare), just return a leaf node
+
+    // partitioning the dataset in place: the left partition, then the right one, each in its original order
+    Point* spare = &scratch.spare[first];
+    int l = 0, r = leftN;
+    for(int i=0; i<n; i++){
+        if(i==idA || (!ball && i==idB)) continue;
+        if(goesLeft(i)){
+            side[l] = distA[i];
+            spare[l++] = arr[i];
+        }
+        else{
+            side[r] = ball ? distA[i] : distB[i];
+            spare[r++] = arr[i];
+        }
+    }
+    copy(spare, spare+leftN+rightN, arr);
+
+    meter.charge(sizeof(TreeNode));
+    TreeNode* node = new TreeNode(pA, ball ? pA : pB);
+    stats.pivotCount += (ball || idA<0) ? 1 : 2;
+    for(int i=0; i<leftN; i++) node->radiusA = max(node->radiusA, side[i]);
+    for(int i=leftN; i<leftN+rightN; i++) node->radiusB = max(node->radiusB, side[i]);
+    if(ball){
+        node->ball = true;
+        node->innerRadius = node->radiusB;
+        for(int i=leftN; i<leftN+rightN; i++) node->innerRadius = min(node->innerRadius, side[i]);
+    }
+
+    // recursively build the tree, each child gets the distances to the pivot on its side, the keys of a leaf and the
+    // distances to its inherited pivot in a reusing tree
+    SplitRng leftRng = rng.split();
+    SplitRng rightRng = rng.split();
+    try{
+        node->left = buildGHT(first, leftN, reusesPivots ? &node->pivotA : nullptr, true, depth+1, leftRng);
+        node->right = buildGHT(first+leftN, rightN, reusesPivots ? &node->pivotB : nullptr, true, depth+1, rightRng);
+    }
+    catch(...){ // over budget further down, nothing of this subtree is kept
+        deleteCounted(node);
+        throw;
+    }
+    return node;
+}
+
+
+// ---------------------- Merge ----------------------
+void GHTIndex::merge(const MetricIndex &other){
+    vector<Point> incoming;
+    other.collect(incoming);
+    if(stats.pointCount+(int)incoming.size()>N_MAX) throw length_error("GHTIndex::merge: more points than N_MAX");
+    SplitRng rng(seed+stats.pointCount); // a different stream per merge, still fixed by the seed and the history
+    meter.budget = memoryBudget;
+    meter.peak = meter.live;
+    try{
+        MemoryCharge held(meter, (long long)incoming.size()*sizeof(Point));
+        root = mergeGHT(root, incoming.data(), (int)incoming.size(), nullptr, nullptr, 0, rng);
+        relayout(layoutOrder);
+    }
+    catch(...){ // over budget: the tree holds what was merged so far, searched through the pointers
+        relayout(0);
+        stats.pointCount = treeSize(root, false, reusesPivots);
+        stats.memoryBytes = meter.live;
+        throw;
+    }
+    stats.pointCount += (int)incoming.size();
+    stats.memoryBytes = meter.live;
+    stats.peakBuildBytes = meter.peak;
+}
+
+// adds arr[0..n) to the subtree at node and returns its new root
+// a subtree is rebuilt before the old one is freed, so running over budget leaves the old one in place
+TreeNode* GHTIndex::mergeGHT(TreeNode* node, const Point arr[], int n, const Point* reused, const Point* sidePivot, int depth, SplitRng &rng){
+    if(n==0) return node;
+    if(node==nullptr) return buildFrom(arr, n, reused, sidePivot, depth, rng);
+
+    bool inherited = reused!=nullptr;
+    int size = treeSize(node, inherited, reusesPivots);
+    if(node->isLeaf || n>=size){
+        MemoryCharge held(meter, (long long)(n+size)*sizeof(Point));
+        vector<Point> all;
+        all.reserve(n+size);
+        all.assign(arr, arr+n);
+        int pivots = gatherTree(node, inherited, reusesPivots, all);
+        TreeNode* rebuilt = buildFrom(all.data(), (int)all.size(), reused, sidePivot, depth, rng);
+        stats.pivotCount -= pivots;
+        deleteCounted(node);
+        return rebuilt;
+    }
+
+    // the same side rule as building: nearer to pivotA goes left, or at a vantage point split nearer to the inner
+    // ball than to the outer shell; the covering radii and the shell grow to take the points in
+    MemoryCharge held(meter, 2LL*n*sizeof(Point));
+    vector<Point> leftPartition, rightPartition;
+    leftPartition.reserve(n);
+    rightPartition.reserve(n);
+    for(int i=0; i<n; i++){
+        float dA = distance(arr[i], node->pivotA);
+        float dB = dA;
+        stats.computationsBuild++;
+        if(!node->ball){
+            dB = distance(arr[i], node->pivotB);
+            stats.computationsBuild++;
+        }
+        if(node->ball ? dA <= (node->radiusA+node->innerRadius)/2 : dA<=dB){
+            leftPartition.push_back(arr[i]);
+            node->radiusA = max(node->radiusA, dA);
+        }
+        else{
+            rightPartition.push_back(arr[i]);
+            node->radiusB = max(node->radiusB, dB);
+            if(node->ball) node->innerRadius = min(node->innerRadius, dA);
+        }
+    }
+    SplitRng leftRng = rng.split();
+    SplitRng rightRng = rng.split();
+    node->left = mergeGHT(node->left, leftPartition.data(), (int)leftPartition.size(), reusesPivots ? &node->pivotA : nullptr, &node->pivotA, depth+1, leftRng);
+    node->right = mergeGHT(node->right, rightPartition.data(), (int)rightPartition.size(), reusesPivots ? &node->pivotB : nullptr, &node->pivotB, depth+1, rightRng);
+    return node;
+}
+
+void GHTIndex::collect(vector<Point> &out) const{
+    gatherTree(root, false, reusesPivots, out);
+}
+
+
+// ---------------------- Search ----------------------
+void GHTIndex::search(const Point &q, ResultSet &result) const{
+    if(!flatNodes.empty()) searchFlat(0, q, result, -1, 0);
+    else search(root, q, result, -1, 0);
+}
+
+// sideDist is d(q, the parent's pivot on node's side), which is node's pivotA in a reusing tree (offered there already),
+// -1 at the root; bound is a lower bound on the distance from q to anything below node, what is left out when the
+// search runs out
+void GHTIndex::search(const TreeNode* node, const Point &q, ResultSet &result, float sideDist, float bound) const{
+    if(node==nullptr) return;
+    if(result.exhausted()){
+        result.leaveOut(bound);
+        return;
+    }
+
+    // if a leaf is encountered, explore the bucket for the nearest neighbor
+    if(node->isLeaf){
+        scanLeaf(node->bucket, node->keys, node->bucketSize, q, sideDist, bound, result);
+        return;
+    }
+
+    float dA = reusesPivots ? sideDist : -1;
+    if(dA<0){
+        dA = distance(q, node->pivotA);
+        result.computations++;
+        result.offer(node->pivotA, dA);
+    }
+    float dB = dA;
+    if(!node->ball){
+        dB = distance(q, node->pivotB);
+        result.computations++;
+        result.offer(node->pivotB, dB);
+    }
+
+    // the side the query lies on is explored first, so the bound is as tight as possible for the other
+    // a side is skipped when the ball of radius r around q cannot reach it (see childBounds), or this node cannot
+    float leftBound, rightBound;
+    bool leftFirst = childBounds(*node, dA, dB, leftBound, rightBound);
+    leftBound = max(bound, leftBound);
+    rightBound = max(bound, rightBound);
+    if(leftFirst){
+        if(leftBound <= result.bound()) search(node->left, q, result, dA, leftBound);
+        if(rightBound <= result.bound()) search(node->right, q, result, dB, rightBound);
+    }
+    else{
+        if(rightBound <= result.bound()) search(node->right, q, result, dB, rightBound);
+        if(leftBound <= result.bound()) search(node->left, q, result, dA, leftBound);
+    }
+}
+
+// same traversal as search() above, over the contiguous layout
+void GHTIndex::searchFlat(int at, const Point &q, ResultSet &result, float sideDist, float bound) const{
+    if(at<0) return;
+    if(result.exhausted()){
+        result.leaveOut(bound);
+        return;
+    }
+    const FlatNode &node = flatNodes[at];
+
+    if(node.isLeaf){
+        scanLeaf(&flatPoints[node.first], node.keyed ? &flatKeys[node.first] : nullptr, node.count, q, sideDist, bound, result);
+        return;
+    }
+
+    float dA = reusesPivots ? sideDist : -1;
+    if(dA<0){
+        dA = distance(q, node.pivotA);
+        result.computations++;
+        result.offer(node.pivotA, dA);
+    }
+    float dB = dA;
+    if(!node.ball){
+        dB = distance(q, node.pivotB);
+        result.computations++;
+        result.offer(node.pivotB, dB);
+    }
+
+    float leftBound, rightBound;
+    bool leftFirst = childBounds(node, dA, dB, leftBound, rightBound);
+    leftBound = max(bound, leftBound);
+    rightBound = max(bound, rightBound);
+    if(leftFirst){
+        if(leftBound <= result.bound()) searchFlat(node.left, q, result, dA, leftBound);
+        if(rightBound <= result.bound()) searchFlat(node.right, q, result, dB, rightBound);
+    }
+    else{
+        if(rightBound <= result.bound()) searchFlat(node.right, q, result, dB, rightBound);
+        if(leftBound <= result.bound()) searchFlat(node.left, q, result, dA, leftBound);
+    }
+}
+
+// offers the points of a leaf to result; with keys, the scan starts at the points whose key is nearest sideDist and
+// widens outwards: a point is at least |sideDist-key| from q, so it stops once the keys on both sides are farther
+// than r from sideDist
+void GHTIndex::scanLeaf(const Point points[], const float keys[], int count, const Point &q, float sideDist, float bound, ResultSet &result) const{
+    if(keys==nullptr || sideDist<0){
+        for(int i=0; i<count; i++){
+            if(result.exhausted()){
+                result.leaveOut(bound);
+                return;
+            }
+            float d = distance(q, points[i]);
+            result.computations++;
+            result.offer(points[i], d);
+        }
+        return;
+    }
+
+    int hi = (int)(lower_bound(keys, keys+count, sideDist)-keys);
+    int lo = hi-1;
+    while(lo>=0 || hi<count){
+        // the nearer of the next key up and the next key down, no point left is nearer to q than its gap
+        bool up = lo<0 || (hi<count && keys[hi]-sideDist <= sideDist-keys[lo]);
+        float gap = up ? keys[hi]-sideDist : sideDist-keys[lo];
+        if(gap > result.bound()) return;
+        if(result.exhausted()){
+            result.leaveOut(max(bound, gap));
+            return;
+        }
+        int i = up ? hi++ : lo--;
+        float d = distance(q, points[i]);
+        result.computations++;
+        result.offer(points[i], d);
+    }
+}
+
+
+// ---------------------- Layout ----------------------
+static int treeHeight(const TreeNode* node){
+    if(node==nullptr) return 0;
+    if(node->isLeaf) return 1;
+    return 1+max(treeHeight(node->left), treeHeight(node->right));
+}
+
+// the nodes exactly depth levels below node
+static void nodesAtDepth(TreeNode* node, int depth, vector<TreeNode*> &out){
+    if(node==nullptr) return;
+    if(depth==0){
+        out.push_back(node);
+        return;
+    }
+    if(node->isLeaf) return;
+    nodesAtDepth(node->left, depth-1, out);
+    nodesAtDepth(node->right, depth-1, out);
+}
+
+// van Emde Boas order of the top height levels below node: the upper half of those levels, recursively,
+// followed by every subtree hanging off its bottom, each recursively
+static void vebOrder(TreeNode* node, int height, vector<TreeNode*> &order){
+    if(node==nullptr || height<=0) return;
+    if(height==1){
+        order.push_back(node);
+        return;
+    }
+    int top = height/2;
+    vebOrder(node, top, order);
+    vector<TreeNode*> bottom;
+    nodesAtDepth(node, top, bottom);
+    for(TreeNode* subtree : bottom) vebOrder(subtree, height-top, order);
+}
+
+// the copy is charged to the meter like the tree, it is held alongside it
+void GHTIndex::relayout(int order){
+    meter.release((long long)flatNodes.capacity()*sizeof(FlatNode)+(long long)flatPoints.capacity()*(sizeof(Point)+sizeof(float)));
+    vector<FlatNode>().swap(flatNodes);
+    vector<Point>().swap(flatPoints);
+    vector<float>().swap(flatKeys);
+    flatHeight = 0;
+    if(order==0 || root==nullptr) return;
+    flatHeight = treeHeight(root);
+
+    vector<TreeNode*> nodes;
+    if(order==1){
+        queue<TreeNode*> pending;
+        pending.push(root);
+        while(!pending.empty()){
+            TreeNode* node = pending.front();
+            pending.pop();
+            nodes.push_back(node);
+            if(node->isLeaf) continue;
+            if(node->left) pending.push(node->left);
+            if(node->right) pending.push(node->right);
+        }
+    }
+    else vebOrder(root, flatHeight, nodes);
+
+    unordered_map<const TreeNode*, int> position;
+    for(int i=0; i<(int)nodes.size(); i++) position[nodes[i]] = i;
+    auto positionOf = [&](const TreeNode* node){
+        return (node==nullptr) ? -1 : position[node];
+    };
+
+    int leafPoints = 0;
+    for(const TreeNode* node : nodes) leafPoints += node->bucketSize;
+    meter.charge((long long)nodes.size()*sizeof(FlatNode)+(long long)leafPoints*(sizeof(Point)+sizeof(float)));
+    flatNodes.resize(nodes.size());
+    flatPoints.reserve(leafPoints);
+    flatKeys.reserve(leafPoints);
+    for(int i=0; i<(int)nodes.size(); i++){
+        const TreeNode* node = nodes[i];
+        FlatNode &flat = flatNodes[i];
+        flat.isLeaf = node->isLeaf;
+        flat.left = flat.right = -1;
+        flat.first = flat.count = 0;
+        flat.keyed = node->keys!=nullptr;
+        flat.radiusA = node->radiusA;
+        flat.radiusB = node->radiusB;
+        flat.ball = node->ball;
+        flat.innerRadius = node->innerRadius;
+        if(node->isLeaf){
+            flat.first = (int)flatPoints.size();
+            flat.count = node->bucketSize;
+            flatPoints.insert(flatPoints.end(), node->bucket, node->bucket+node->bucketSize);
+            if(node->keys) flatKeys.insert(flatKeys.end(), node->keys, node->keys+node->bucketSize);
+            else flatKeys.resize(flatPoints.size(), 0);
+        }
+        else{
+            flat.pivotA = node->pivotA;
+            flat.pivotB = node->pivotB;
+            flat.left = positionOf(node->left);
+            flat.right = positionOf(node->right);
+        }
+    }
+}
+
+
+// ---------------------- Batched Search ----------------------
+#if defined(__GNUC__)
+#define PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define PREFETCH(addr)
+#endif
+
+static void prefetchBytes(const void* start, size_t bytes){
+    const char* p = (const char*)start;
+    for(size_t offset=0; offset<bytes; offset+=64) PREFETCH(p+offset);
+}
+
+// the pivots of an internal node, or the points of a leaf
+void GHTIndex::prefetch(int at) const{
+    if(at<0) return;
+    const FlatNode &node = flatNodes[at];
+    PREFETCH(&node.isLeaf);
+    if(node.isLeaf) prefetchBytes(&flatPoints[node.first], node.count*sizeof(Point));
+    else prefetchBytes(&node.pivotA, 2*sizeof(Point));
+}
+
+// explores the next node of one query that survives the tests on its bounds, in the same order searchFlat would
+// once the query runs out of budget or time, the visits still pending are what it leaves out
+void GHTIndex::step(const Point &q, ResultSet &result, Frame pending[], int &top) const{
+    while(top>0){
+        Frame frame = pending[--top];
+        float r = result.bound();
+        if(frame.at<0 || frame.bound > r) continue;
+        if(result.exhausted()){
+            result.leaveOut(frame.bound);
+            continue;
+        }
+        const FlatNode &node = flatNodes[frame.at];
+
+        if(node.isLeaf){
+            scanLeaf(&flatPoints[node.first], node.keyed ? &flatKeys[node.first] : nullptr, node.count, q, frame.sideDist, frame.bound, result);
+            return;
+        }
+
+        float dA = reusesPivots ? frame.sideDist : -1;
+        if(dA<0){
+            dA = distance(q, node.pivotA);
+            result.computations++;
+            result.offer(node.pivotA, dA);
+        }
+        float dB = dA;
+        if(!node.ball){
+            dB = distance(q, node.pivotB);
+            result.computations++;
+            result.offer(node.pivotB, dB);
+        }
+
+        // the far side is pushed first so the near side is explored first, its test is made once the near side is done
+        float leftBound, rightBound;
+        bool leftFirst = childBounds(node, dA, dB, leftBound, rightBound);
+        leftBound = max(frame.bound, leftBound);
+        rightBound = max(frame.bound, rightBound);
+        if(leftFirst){
+            pending[top++] = {node.right, dB, rightBound};
+            pending[top++] = {node.left, dA, leftBound};
+        }
+        else{
+            pending[top++] = {node.left, dA, leftBound};
+            pending[top++] = {node.right, dB, rightBound};
+        }
+        return;
+    }
+}
+
+void GHTIndex::searchBatch(const Point queries[], ResultSet results[], int count) const{
+    if(flatNodes.empty()){
+        for(int i=0; i<count; i++) search(queries[i], results[i]);
+        return;
+    }
+
+    int group = max(1, batchGroup);
+    int depth = flatHeight+1; // deepest a stack of pending visits can get
+    vector<Frame> pending(group*depth);
+    vector<int> top(group, 0);
+    vector<int> slot(group, -1); // query each slot is working on, -1 once the slot is idle
+    int next = 0, active = 0;
+    for(int s=0; s<group && next<count; s++){
+        slot[s] = next++;
+        pending[s*depth] = {0, -1, 0};
+        top[s] = 1;
+        active++;
+    }
+    prefetch(0);
+
+    while(active>0){
+        for(int s=0; s<group; s++){
+            if(slot[s]<0) continue;
+            Frame* stack = &pending[s*depth];
+            step(queries[slot[s]], results[slot[s]], stack, top[s]);
+            if(top[s]==0){ // this query is answered, start the next one in its slot
+                if(next<count){
+                    slot[s] = next++;
+                    stack[0] = {0, -1, 0};
+                    top[s] = 1;
+                }
+                else{
+                    slot[s] = -1;
+                    active--;
+                    continue;
+                }
+            }
+            prefetch(stack[top[s]-1].at);
+        }
+    }
+}
+
+// ---------------------- Build Report ----------------------
+void GHTIndex::report(BuildReport &report) const{
+    collectReport(root, 0, report);
+}
+
+// walks the tree filling the report, returns the number of points stored below node
+// an inherited pivot is counted where it is first stored
+int GHTIndex::collectReport(const TreeNode* node, int depth, BuildReport &report) const{
+    if(node==nullptr) return 0;
+    if(node->isLeaf){
+        report.addLeaf(depth, node->bucketSize, node->bytes());
+        return node->bucketSize;
+    }
+    int leftN = collectReport(node->left, depth+1, report);
+    int rightN = collectReport(node->right, depth+1, report);
+    int stored = storedPivots(node, reusesPivots && depth>0);
+    report.addSplit(depth, 2, stored, splitImbalance(leftN, rightN), sizeof(TreeNode));
+    return leftN+rightN+stored;
+}
@@ -0,0 +1,294 @@
+#pragma once
+#include "metric_index.h"
+#include <algorithm>
+
+
+// ---------------------- Structures ----------------------
+struct TreeNode{
+    Point pivotA;
+    Point pivotB;
+    Point* bucket; // contains points in the partition corresponding to the TreeNode, sized to them, nullptr in internal nodes
+    int bucketSize;
+    // of a leaf below a split, each bucket point's distance to the parent's pivot on the leaf's side, ascending (the
+    // bucket is sorted along with it); nullptr in internal nodes and in a leaf that is the whole tree
+    float* keys;
+    TreeNode* left;
+    TreeNode* right;
+    float radiusA, radiusB; // covering radii: every point below left is within radiusA of pivotA, below right within radiusB of pivotB
+    bool ball; // a vantage point split around pivotA alone (pivotB is a copy of it): left holds the points nearer than the right ones
+    float innerRadius; // of a vantage point split, every point below right is at least this far from pivotA
+    bool isLeaf;
+
+    TreeNode(const Point &a, const Point &b){ // constructor for internal nodes
+        pivotA = a;
+        pivotB = b;
+        radiusA = radiusB = 0;
+        ball = false;
+        innerRadius = 0;
+        left = nullptr;
+        right = nullptr;
+        isLeaf = false;
+        bucket = nullptr;
+        bucketSize = 0;
+        keys = nullptr;
+    }
+
+    TreeNode(const Point arr[], int n){ // constructor for leaf nodes
+        bucket = new Point[n];
+        for(int i=0; i<n; i++){
+            bucket[i] = arr[i];
+        }
+        bucketSize = n;
+        keys = nullptr;
+        left = right = nullptr;
+        radiusA = radiusB = 0;
+        ball = false;
+        innerRadius = 0;
+        isLeaf = true;
+    }
+
+    TreeNode(const TreeNode &other){ // copies the node with a bucket of its own, the children are still other's
+        pivotA = other.pivotA;
+        pivotB = other.pivotB;
+        bucketSize = other.bucketSize;
+        bucket = nullptr;
+        if(other.bucket){
+            bucket = new Point[bucketSize];
+            for(int i=0; i<bucketSize; i++){
+                bucket[i] = other.bucket[i];
+            }
+        }
+        keys = nullptr;
+        if(other.keys){
+            keys = new float[bucketSize];
+            for(int i=0; i<bucketSize; i++){
+                keys[i] = other.keys[i];
+            }
+        }
+        left = other.left;
+        right = other.right;
+        radiusA = other.radiusA;
+        radiusB = other.radiusB;
+        ball = other.ball;
+        innerRadius = other.innerRadius;
+        isLeaf = other.isLeaf;
+    }
+    TreeNode& operator=(const TreeNode&) = delete;
+
+    ~TreeNode(){
+        delete []bucket;
+        delete []keys;
+    }
+
+    // bytes the node holds, its bucket and keys included
+    long long bytes() const{
+        return sizeof(TreeNode)+(long long)bucketSize*(sizeof(Point)+(keys ? sizeof(float) : 0));
+    }
+};
+
+
+// a node of the contiguous layout made by GHTIndex::relayout, with the pivots inline next to the child positions
+struct FlatNode{
+    Point pivotA;
+    Point pivotB;
+    int left, right; // positions in flatNodes, -1 for no child
+    int first, count; // a leaf's points are flatPoints[first..first+count)
+    float radiusA, radiusB; // as in TreeNode
+    bool ball;
+    float innerRadius;
+    bool isLeaf;
+    bool keyed; // a leaf whose points are sorted by flatKeys, as a TreeNode's by its keys
+};
+
+
+// lower bounds on the distance from q to any point below the left and right child of an internal node, from
+// dA = d(q,pivotA) and dB = d(q,pivotB) (dB = dA at a vantage point split); returns whether q is on the left side
+// a hyperplane split bounds a side by the hyperplane and by its covering ball, a vantage point split by its shell
+template<class Node> inline bool childBounds(const Node &node, float dA, float dB, float &left, float &right){
+    if(node.ball){
+        left = dA-node.radiusA;
+        right = std::max(node.innerRadius-dA, dA-node.radiusB);
+        return dA <= (node.radiusA+node.innerRadius)/2;
+    }
+    left = std::max((dA-dB)/2, dA-node.radiusA);
+    right = std::max((dB-dA)/2, dB-node.radiusB);
+    return dA<=dB;
+}
+
+
+// ---------------------- Index ----------------------
+// generalised hyperplane tree: every internal node holds two pivots, points nearer to pivotA go left and
+// the rest go right. The variants below differ only in how a node's pivots are chosen.
+// each node also keeps the covering radius of either side, so search prunes a side with its ball as well as the
+// hyperplane, using the distances to the pivots it computes anyway. A node may instead split around pivotA alone at
+// the median distance (see splitRule), search handles both kinds of node in the same traversal
+// a leaf keeps its points sorted by their distance to the parent's pivot on its side; search, which knows the query's
+// distance to that pivot, scans outward from it and stops where the triangle inequality puts the rest out of reach
+class GHTIndex : public MetricIndex{
+public:
+    // a split is rejected and its pivots chosen again when |leftN-rightN|/(leftN+rightN) exceeds this
+    // 1 accepts every split; only variants with randomised pivots resample
+    float maxImbalance = 1.0f;
+    int maxResamples = 8; // after this many rejections the last split is accepted anyway
+
+    // how an internal node splits its points
+    // 0 - generalised hyperplane: nearer to pivotA than to pivotB goes left
+    // 1 - vantage point: pivotA alone, the points up to the median distance from it go left, one distance per point
+    // 2 - per node, whichever of the two splits over the node's pivots keeps its points farther from the boundary,
+    //     weighted by balance; both are measured, so it costs what a hyperplane split does
+    // a tree that reuses pivots always splits by hyperplane, its children inherit one pivot each
+    int splitRule = 0;
+    std::vector<int> levelSplits; // levelSplits[d] overrides splitRule for the nodes d levels below the root
+
+    // order in which build lays the nodes out in one buffer for searching
+    // 0 - none, search follows the TreeNode pointers
+    // 1 - breadth-first
+    // 2 - van Emde Boas: the top half of the levels first, then each subtree hanging below it, recursively,
+    //     so a descent touches O(log_B n) cache blocks whatever the block size B
+    int layoutOrder = 0;
+    int batchGroup = 8; // queries searchBatch advances together
+
+    TreeNode* root = nullptr;
+    std::vector<FlatNode> flatNodes; // the laid out tree, flatNodes[0] is the root
+    std::vector<Point> flatPoints; // leaf points, grouped per leaf in layout order
+    std::vector<float> flatKeys; // of flatPoints, as TreeNode::keys
+    int flatHeight = 0; // levels in the laid out tree
+
+    GHTIndex(int metricType, int leafSize) : MetricIndex(metricType, leafSize) {}
+    GHTIndex(const GHTIndex &other); // deep copy
+    GHTIndex& operator=(const GHTIndex&) = delete;
+    ~GHTIndex();
+
+    void build(const Point arr[], int n) override;
+    void search(const Point &q, ResultSet &result) const override;
+    void report(BuildReport &report) const override;
+    void collect(std::vector<Point> &out) const override;
+
+    // the points of other are routed down the existing hyperplanes; a subtree is only rebuilt where they reach
+    // a leaf or where they outnumber the points already below it, so the top levels keep their pivots and a
+    // small batch costs about one root-to-leaf path per point
+    void merge(const MetricIndex &other) override;
+
+    // copies the built tree into flatNodes/flatPoints in the given order (see layoutOrder), 0 drops the copy
+    void relayout(int order);
+
+    // whether pivotA of every internal node below the root is the parent's pivot rather than a point of its own
+    bool inheritsPivots() const{
+        return reusesPivots;
+    }
+
+    // answers queries[0..count) into results[0..count), same answers and distance computations as search()
+    // over a laid out tree, batchGroup queries take turns visiting one node each; while one query computes
+    // distances, the nodes the others visit next are being prefetched, which hides the memory latency of a descent
+    void searchBatch(const Point queries[], ResultSet results[], int count) const;
+
+protected:
+    // in a monotonous bisector tree each child keeps its parent's pivot on its own side as pivotA
+    bool reusesPivots = false;
+
+    // picks the pivots of a node over arr[0..n) and returns their positions in idA, idB
+    // reused is the pivot inherited from the parent when reusesPivots is set (nullptr at the root);
+    // it becomes pivotA and idA is set to -1. Random choices come from rng, the node's own generator
+    virtual void choosePivots(const Point arr[], int n, const Point* reused, int &idA, int &idB, SplitRng &rng) = 0;
+
+    // whether calling choosePivots again can give a different split
+    virtual bool randomPivots() const{
+        return false;
+    }
+
+private:
+    // scratch of a build, sized to its points once and shared by every level of the recursion: a node works on the
+    // range [first, first+n) of each array, its children on the two parts of that range it partitions the points into
+    struct BuildScratch{
+        std::vector<Point> points; // the points being built over
+        std::vector<Point> spare; // a partition is written here, then copied back in place
+        std::vector<float> side; // a point's distance to the pivot on its side of the parent's split
+        std::vector<float> distA, distB; // to the pivots of the node being split
+        std::vector<float> ranked; // distances being ranked for a median
+    };
+    BuildScratch scratch;
+    MemoryMeter meter; // what build and merge hold, charged against memoryBudget
+
+    // builds over arr[0..n) through the scratch, reserving and then releasing it
+    // sidePivot is the parent's pivot on this side, the keys of a leaf are its distances (nullptr at the root)
+    TreeNode* buildFrom(const Point arr[], int n, const Point* reused, const Point* sidePivot, int depth, SplitRng &rng);
+    // known - scratch.side[first..first+n) holds the distances to the parent's pivot on this side (*reused when the
+    // pivot is inherited), which the parent computed
+    TreeNode* buildGHT(int first, int n, const Point* reused, bool known, int depth, SplitRng &rng);
+    // keys, when given, are sorted into the leaf along with the points
+    TreeNode* newLeaf(const Point arr[], const float keys[], int n);
+    void deleteCounted(TreeNode* node);
+    TreeNode* mergeGHT(TreeNode* node, const Point arr[], int n, const Point* reused, const Point* sidePivot, int depth, SplitRng &rng);
+    void search(const TreeNode* node, const Point &q, ResultSet &result, float sideDist, float bound) const;
+    void searchFlat(int at, const Point &q, ResultSet &result, float sideDist, float bound) const;
+    void scanLeaf(const Point points[], const float keys[], int count, const Point &q, float sideDist, float bound, ResultSet &result) const;
+
+    // a pending visit of a batched query: node at is explored only if bound <= r when it is reached, bound being
+    // what childBounds gave for the subtree at its parent, or the parent's own bound if that is larger
+    struct Frame{
+        int at;
+        float sideDist;
+        float bound;
+    };
+    // pending holds the query's stack of visits (at most flatHeight+1 of them), top is its size
+    void step(const Point &q, ResultSet &result, Frame pending[], int &top) const;
+    void prefetch(int at) const;
+    int collectReport(const TreeNode* node, int depth, BuildReport &report) const;
+};
+
+// pivots picked uniformly at random
+class RandomPivotingGHT : public GHTIndex{
+public:
+    RandomPivotingGHT(int metricType=1, int leafSize=4) : GHTIndex(metricType, leafSize) {}
+    const char* name() const override{
+        return "Random Pivoting";
+    }
+
+    MetricIndex* clone() const override{
+        return new RandomPivotingGHT(*this);
+    }
+
+protected:
+    void choosePivots(const Point arr[], int n, const Point* reused, int &idA, int &idB, SplitRng &rng) override;
+    bool randomPivots() const override{
+        return true;
+    }
+};
+
+// the farthest pair of points in the partition, found by comparing every pair
+class MaximumSeparationGHT : public GHTIndex{
+public:
+    MaximumSeparationGHT(int metricType=1, int leafSize=4) : GHTIndex(metricType, leafSize) {}
+    const char* name() const override{
+        return "Maximum Separation";
+    }
+
+    MetricIndex* clone() const override{
+        return new MaximumSeparationGHT(*this);
+    }
+
+protected:
+    void choosePivots(const Point arr[], int n, const Point* reused, int &idA, int &idB, SplitRng &rng) override;
+};
+
+// monotonous bisector tree: below the root only one new random pivot per node, the other is inherited
+// from the parent, so searching reuses the parent's distance to it
+class ReusingPivotsMBT : public GHTIndex{
+public:
+    ReusingPivotsMBT(int metricType=1, int leafSize=4) : GHTIndex(metricType, leafSize){
+        reusesPivots = true;
+    }
+    const char* name() const override{
+        return "Reusing Pivots (MBT)";
+    }
+
+    MetricIndex* clone() const override{
+        return new ReusingPivotsMBT(*this);
+    }
+
+protected:
+    void choosePivots(const Point arr[], int n, const Point* reused, int &idA, int &idB, SplitRng &rng) override;
+    bool randomPivots() const override{
+        return true;
+    }
+};
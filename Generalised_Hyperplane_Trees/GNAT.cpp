@@ -1,321 +1,429 @@
-#include "dataset.h"
-#include <iostream>
-#include <cmath>
-#include <limits>
-#include <chrono> // measure build and search time
-#include <random> // generate pseudo random float numbers
-#include <iomanip> // set precision to 2
-
+#include "GNAT.h"
+#include <cstdlib>
+#include <stdexcept>
+#include <algorithm>
 using namespace std;
-using namespace chrono;
-
-#define D 50 // dimension of data
-#define N_MAX 2000 // cardinality of dataset
-#define M 12 // no of pivots per internal node
-#define ITERATIONS 2000 // average out results over 2000 iterations
-
-// --------------------Global Counters---------------------
-int computationsBuild = 0; // distance computations in building the GHT
-int computationsSearch = 0; // distance computations in searching for the neighbour
-int pivotCount = 0; // pivots in the GHT
-// 0 - L2 distance
-// 1 - L1 distance
-// 2 - L_inf distance 
-int metricType = 2; 
-
- 
-// ---------------------- Structures ----------------------
-struct Point{
-    float coords[D];
-};
-
-struct GNATNode{
-    Point pivots[M];
-    float rangeLow[M][M];
-    float rangeHigh[M][M];
-    GNATNode* child[M];
-    int m;
-    bool isLeaf;
-    Point leafPoints[N_MAX];
-    int leafCount;
-
-    GNATNode(){
-        m = 0;
-        isLeaf = false;
-        leafCount = 0;
-        for(int i=0; i<M; i++){
-            child[i] = nullptr;
+
+
+// ---------------------- Delete/cleanup ----------------------
+static void deleteGNAT(GNATNode* node){
+    if(!node) return;
+    if(!node->isLeaf){
+        for(int i=0; i<node->m; i++){
+            if(node->child[i]){
+                deleteGNAT(node->child[i]);
+                node->child[i] = nullptr;
+            }
         }
     }
-};
-
-// ---------------------- Distance ----------------------
-float distance(Point x, Point y){
-    float d = 0;
-    if(metricType==0){ // L2 distance
-        for(int i=0; i<D; i++){
-            float diff = x.coords[i]-y.coords[i];
-            d += diff*diff;
+    delete node;
+}
+
+static GNATNode* copyGNAT(const GNATNode* node){
+    if(!node) return nullptr;
+    GNATNode* copy = new GNATNode(*node);
+    if(!node->isLeaf){
+        for(int i=0; i<node->m; i++){
+            copy->child[i] = copyGNAT(node->child[i]);
         }
-        return sqrtf(d);
     }
-    else if(metricType==1){ // L1 distance
-        for(int i=0; i<D; i++){
-            float diff = fabs(x.coords[i]-y.coords[i]);
-            d += diff;
-        }
-        return d;
+    return copy;
+}
+
+// appends the points stored in the subtree to out, returns the pivots among them
+static int gatherGNAT(const GNATNode* node, vector<Point> &out){
+    if(!node) return 0;
+    if(node->isLeaf){
+        out.insert(out.end(), node->leafPoints, node->leafPoints+node->leafCount);
+        return 0;
+    }
+    int pivots = node->m;
+    out.insert(out.end(), node->pivots, node->pivots+node->m);
+    for(int i=0; i<node->m; i++){
+        pivots += gatherGNAT(node->child[i], out);
     }
-    else{ // L_inf distance
-        for(int i=0; i<D; i++){
-            float diff = fabs(x.coords[i]-y.coords[i]);
-            d = max(diff, d);
+    return pivots;
+}
+
+// bytes held by the nodes of the subtree
+static long long gnatBytes(const GNATNode* node){
+    if(!node) return 0;
+    long long bytes = node->bytes();
+    if(!node->isLeaf){
+        for(int i=0; i<node->m; i++){
+            bytes += gnatBytes(node->child[i]);
         }
-        return d;
     }
-    return -1;
+    return bytes;
+}
+
+// points stored in the subtree, without computing any distance
+static int gnatSize(const GNATNode* node){
+    if(!node) return 0;
+    if(node->isLeaf) return node->leafCount;
+    int size = node->m;
+    for(int i=0; i<node->m; i++){
+        size += gnatSize(node->child[i]);
+    }
+    return size;
+}
+
+GNATIndex::GNATIndex(const GNATIndex &other) : MetricIndex(other){
+    arity = other.arity;
+    arityPolicy = other.arityPolicy;
+    pivotPolicy = other.pivotPolicy;
+    maxImbalance = other.maxImbalance;
+    maxResamples = other.maxResamples;
+    meter = other.meter;
+    root = copyGNAT(other.root);
+}
+
+GNATIndex::~GNATIndex(){
+    deleteGNAT(root);
 }
 
 
 // ---------------------- Build ----------------------
-GNATNode* buildGNAT(Point arr[], int n, int leaf_size = 4) {
-    if(n<=0) return nullptr;
-    GNATNode* node = new GNATNode();
-
-    if(n<=leaf_size){
-        node->isLeaf = true;
-        node->leafCount = n;
-        for(int i=0; i<n; i++){
-            node->leafPoints[i] = arr[i];
-        }  
-        return node;
-    }
+void GNATIndex::build(const Point arr[], int n){
+    if(n>N_MAX) throw length_error("GNATIndex::build: more points than N_MAX");
+    deleteGNAT(root);
+    root = nullptr;
+    stats = IndexStats();
+    meter = MemoryMeter();
+    meter.budget = memoryBudget;
+    SplitRng rng(seed);
+    root = buildFrom(arr, n, min(arity, M_MAX), rng);
+    stats.pointCount = n;
+    stats.memoryBytes = meter.live;
+    stats.peakBuildBytes = meter.peak;
+}
 
-    node->m = (n<M)?n:M;
-    pivotCount += node->m;
+void GNATIndex::deleteCounted(GNATNode* node){
+    meter.release(gnatBytes(node));
+    deleteGNAT(node);
+}
 
-    // pick m pivots randomly
-    bool* chosen = new bool[n];
-    for(int i=0; i<n; i++) chosen[i] = false;
-    for(int i=0; i<node->m; i++){
+GNATNode* GNATIndex::buildFrom(const Point arr[], int n, int arity, SplitRng &rng){
+    MemoryCharge reserved(meter, (long long)n*(2*sizeof(Point)+sizeof(int)+sizeof(bool)));
+    scratch.points.assign(arr, arr+n);
+    scratch.spare.resize(n);
+    scratch.owner.resize(n);
+    scratch.chosen.reset(new bool[n]);
+    GNATNode* node;
+    try{
+        node = buildGNAT(0, n, arity, rng);
+    }
+    catch(...){
+        scratch = BuildScratch();
+        throw;
+    }
+    scratch = BuildScratch();
+    return node;
+}
+
+// marks m distinct points of arr as chosen and copies them into pivots
+void GNATIndex::pickRandomPivots(const Point arr[], int n, int m, bool chosen[], Point pivots[], SplitRng &rng){
+    for(int i=0; i<m; i++){
         int id;
         do{
-            id = rand() % n;
+            id = rng.below(n);
         }while(chosen[id]);
         chosen[id] = true;
-        node->pivots[i] = arr[id];
-    }
-
-    // assign each point to nearest pivot
-    Point* subset = new Point[M * N_MAX];
-    int* subsetSize = new int[M];
-    for(int i=0; i<M; i++){
-        subsetSize[i] = 0;
+        pivots[i] = arr[id];
     }
+}
 
-    for(int i=0; i<n; i++){
-        if(chosen[i]) continue;
-        float best = distance(arr[i], node->pivots[0]);
-        computationsBuild++;
-        int bestIdx = 0;
-        for(int j=1; j<node->m; j++){
-            float d = distance(arr[i], node->pivots[j]);
-            computationsBuild++;
-            if(d<best){
-                best = d;
-                bestIdx = j;
-            }
-        }
-        subset[bestIdx*N_MAX+subsetSize[bestIdx]++] = arr[i];
+// greedy farthest-first traversal of a random sample of 3*m candidates: starting from a random candidate,
+// repeatedly take the candidate farthest from all pivots picked so far, giving well separated split points
+void GNATIndex::pickFarthestFirstPivots(const Point arr[], int n, int m, bool chosen[], Point pivots[], SplitRng &rng){
+    int s = min(n, 3*m);
+    int candidates[3*M_MAX];
+    float nearest[3*M_MAX]; // distance from each candidate to its nearest pivot so far
+    for(int i=0; i<s; i++){
+        int id;
+        do{
+            id = rng.below(n);
+        }while(chosen[id]);
+        chosen[id] = true; // reserve while sampling, released below if not picked
+        candidates[i] = id;
+        nearest[i] = numeric_limits<float>::infinity();
     }
+    for(int i=0; i<s; i++) chosen[candidates[i]] = false;
 
-    // compute distance ranges between pivots and subsets
-    for(int i=0; i<node->m; i++){
-        for(int j=0; j<node->m; j++){
-            if(i==j){
-                node->rangeLow[i][j] = 0;
-                node->rangeHigh[i][j] = 0;
-            } 
-            else{
-                float minD = numeric_limits<float>::infinity();
-                float maxD = 0;
-                for(int k=0; k<subsetSize[j]; k++){
-                    float d = distance(node->pivots[i], subset[j*N_MAX+k]);
-                    computationsBuild++;
-                    if(d<minD) minD = d;
-                    if(d>maxD) maxD = d;
-                }
-                float dpp = distance(node->pivots[i], node->pivots[j]);
-                computationsBuild++;
-                if(dpp<minD) minD = dpp;
-                if(dpp>maxD) maxD = dpp;
-                node->rangeLow[i][j] = minD;
-                node->rangeHigh[i][j] = maxD;
+    int next = 0;
+    for(int i=0; i<m; i++){
+        int id = candidates[next];
+        chosen[id] = true;
+        pivots[i] = arr[id];
+        nearest[next] = -1; // never pick the same candidate twice
+
+        next = -1;
+        for(int c=0; c<s; c++){
+            if(nearest[c]<0) continue;
+            if(i<m-1){
+                float d = distance(arr[candidates[c]], pivots[i]);
+                stats.computationsBuild++;
+                if(d<nearest[c]) nearest[c] = d;
             }
+            if(next==-1 || nearest[c]>nearest[next]) next = c;
         }
     }
+}
 
-    // recursively build children
-    for(int i=0; i<node->m; i++){
-        node->child[i] = buildGNAT(subset+i*N_MAX, subsetSize[i], leaf_size);
-    }
-    delete []subset;
-    delete []subsetSize;
-    delete []chosen;
-
-    return node;
+// arity passed down to a child holding size of the parent's n points (Brin's GNAT): the children of a node
+// with m pivots average m pivots each, larger subsets get more and smaller ones fewer
+int GNATIndex::childArity(int m, int size, int n) const{
+    if(arityPolicy==0 || size==0) return min(arity, M_MAX);
+    int arity = (int)lround((double)m*m*size/n);
+    return max(M_MIN, min(M_MAX, arity));
 }
 
-// ---------------------- Search ----------------------
-void search(GNATNode* node, const Point &q, Point &bestPt, float &bestDist) {
-    if (!node) return;
+GNATNode* GNATIndex::buildGNAT(int first, int n, int arity, SplitRng &rng){
+    if(n<=0) return nullptr;
+    Point* arr = &scratch.points[first];
+    if(n<=leafSize){
+        meter.charge(GNATNode::bytesFor(0, n));
+        return new GNATNode(arr, n);
+    }
 
-    if (node->isLeaf) {
-        for (int i = 0; i < node->leafCount; i++) {
-            float d = distance(q, node->leafPoints[i]);
-            computationsSearch++;
-            if (d < bestDist) {
-                bestDist = d;
-                bestPt = node->leafPoints[i];
+    int m = (n<arity)?n:arity;
+    meter.charge(GNATNode::bytesFor(m, 0));
+    GNATNode* node = new GNATNode(m);
+    stats.pivotCount += node->m;
+
+    bool* chosen = &scratch.chosen[first];
+    int* owner = &scratch.owner[first];
+    int subsetSize[M_MAX];
+    float row[M_MAX]; // distances from the point to every pivot
+    for(int attempt=0; ; attempt++){
+        // pick m pivots
+        for(int i=0; i<n; i++) chosen[i] = false;
+        if(pivotPolicy==0) pickRandomPivots(arr, n, node->m, chosen, node->pivots, rng);
+        else pickFarthestFirstPivots(arr, n, node->m, chosen, node->pivots, rng);
+
+        // compute distance ranges between pivots and subsets while assigning each point to its nearest pivot
+        for(int i=0; i<node->m; i++){
+            subsetSize[i] = 0;
+            for(int j=0; j<node->m; j++){
+                node->low(i, j) = (i==j) ? 0 : numeric_limits<float>::infinity();
+                node->high(i, j) = 0;
+            }
+        }
+        for(int k=0; k<n; k++){
+            if(chosen[k]) continue;
+            int j = 0;
+            for(int i=0; i<node->m; i++){
+                row[i] = distance(arr[k], node->pivots[i]);
+                stats.computationsBuild++;
+                if(row[i]<row[j]) j = i;
+            }
+            owner[k] = j;
+            subsetSize[j]++;
+            for(int i=0; i<node->m; i++){
+                if(row[i]<node->low(i, j)) node->low(i, j) = row[i];
+                if(row[i]>node->high(i, j)) node->high(i, j) = row[i];
             }
         }
-        return;
-    }
 
-    float* distPivot = new float[M];
-    for (int i = 0; i < node->m; i++){
-        distPivot[i] = distance(q, node->pivots[i]);
-        computationsSearch++;
+        // as in GHTIndex, small nodes are close to leaves anyway and not worth the extra distance computations
+        int rest = n-node->m;
+        if(rest<=2*leafSize || attempt>=maxResamples) break;
+        int smallest = *min_element(subsetSize, subsetSize+node->m);
+        int largest = *max_element(subsetSize, subsetSize+node->m);
+        if((float)(largest-smallest)/rest<=maxImbalance) break;
+        stats.resampleCount++;
     }
-        
-
-    for (int i = 0; i < node->m; i++) {
-        if (distPivot[i] < bestDist) {
-            bestDist = distPivot[i];
-            bestPt = node->pivots[i];
+    // pivot j belongs to its own subset, so d(pivot i, pivot j) widens both range[i][j] and range[j][i]
+    for(int i=0; i<node->m; i++){
+        for(int j=i+1; j<node->m; j++){
+            float dpp = distance(node->pivots[i], node->pivots[j]);
+            stats.computationsBuild++;
+            node->low(i, j) = min(node->low(i, j), dpp);
+            node->high(i, j) = max(node->high(i, j), dpp);
+            node->low(j, i) = min(node->low(j, i), dpp);
+            node->high(j, i) = max(node->high(j, i), dpp);
         }
     }
 
-    bool* prune = new bool[M];
-    for(int i = 0; i < node->m; i++) prune[i] = false;
-
-    for (int i = 0; i < node->m; i++) {
-        for (int j = 0; j < node->m; j++) {
-            if(i==j) continue;
-            if(prune[j]) continue;
-            if (distPivot[i] - bestDist > node->rangeHigh[i][j] ||
-                distPivot[i] + bestDist < node->rangeLow[i][j]) {
-                prune[j] = true;
-            }
-        }
-    }
+    // the subsets in place, one after the other, each in its original order
+    int subsetFirst[M_MAX];
+    int placed = 0;
     for(int i=0; i<node->m; i++){
-        if(!prune[i]) search(node->child[i], q, bestPt, bestDist);
+        subsetFirst[i] = placed;
+        placed += subsetSize[i];
     }
-    delete []prune;
-    delete []distPivot;
-}
+    Point* spare = &scratch.spare[first];
+    int next[M_MAX];
+    for(int i=0; i<node->m; i++) next[i] = subsetFirst[i];
+    for(int k=0; k<n; k++){
+        if(!chosen[k]) spare[next[owner[k]]++] = arr[k];
+    }
+    copy(spare, spare+placed, arr);
 
-// ---------------------- Delete/cleanup ----------------------
-void deleteGNAT(GNATNode* node){
-    if(!node) return;
-    if(!node->isLeaf){
+    // recursively build children
+    try{
         for(int i=0; i<node->m; i++){
-            if(node->child[i]){
-                deleteGNAT(node->child[i]);
-                node->child[i] = nullptr;
-            }
+            SplitRng childRng = rng.split();
+            node->child[i] = buildGNAT(first+subsetFirst[i], subsetSize[i], childArity(node->m, subsetSize[i], n-node->m), childRng);
         }
     }
-    delete node;
+    catch(...){ // over budget further down, nothing of this subtree is kept
+        deleteCounted(node);
+        throw;
+    }
+    return node;
 }
 
-void printPoint(Point p){
-    cout<<"("<<fixed<<setprecision(2);
-    for(int i=0; i<D; i++){
-        cout<<p.coords[i];
-        if(i<D-1) cout<<", ";
+// ---------------------- Merge ----------------------
+void GNATIndex::merge(const MetricIndex &other){
+    vector<Point> incoming;
+    other.collect(incoming);
+    if(stats.pointCount+(int)incoming.size()>N_MAX) throw length_error("GNATIndex::merge: more points than N_MAX");
+    SplitRng rng(seed+stats.pointCount); // a different stream per merge, still fixed by the seed and the history
+    meter.budget = memoryBudget;
+    meter.peak = meter.live;
+    try{
+        MemoryCharge held(meter, (long long)incoming.size()*sizeof(Point));
+        root = mergeGNAT(root, incoming.data(), (int)incoming.size(), min(arity, M_MAX), rng);
     }
-    cout<<")";
+    catch(...){ // over budget: the tree holds what was merged so far
+        stats.pointCount = gnatSize(root);
+        stats.memoryBytes = meter.live;
+        throw;
+    }
+    stats.pointCount += (int)incoming.size();
+    stats.memoryBytes = meter.live;
+    stats.peakBuildBytes = meter.peak;
 }
 
-
-int main(){
-    // "importing" the dataset
-    Point points[N_MAX];
-    for(int i=0; i<N_MAX; i++){
-        for(int j=0; j<D; j++){
-            points[i].coords[j] = DATASET[i][j];
-        }    
+// adds arr[0..n) to the subtree at node and returns its new root, arity is what a rebuild of it would use
+// a subtree is rebuilt before the old one is freed, so running over budget leaves the old one in place
+GNATNode* GNATIndex::mergeGNAT(GNATNode* node, const Point arr[], int n, int arity, SplitRng &rng){
+    if(n==0) return node;
+    if(!node) return buildFrom(arr, n, arity, rng);
+
+    int size = gnatSize(node);
+    if(node->isLeaf || n>=size){
+        MemoryCharge held(meter, (long long)(n+size)*sizeof(Point));
+        vector<Point> all;
+        all.reserve(n+size);
+        all.assign(arr, arr+n);
+        int pivots = gatherGNAT(node, all);
+        GNATNode* rebuilt = buildFrom(all.data(), (int)all.size(), arity, rng);
+        stats.pivotCount -= pivots;
+        deleteCounted(node);
+        return rebuilt;
     }
 
-    mt19937 rng((unsigned)time(0));
-    uniform_real_distribution<float> dist(-10.0f, 10.0f);
-
-    double totalBuildTime = 0.0;
-    double totalSearchTime = 0.0;
-    long long totalDistBuild = 0, totalDistSearch = 0, totalPivots = 0;
-
-    for(int iter=0; iter<ITERATIONS; iter++){
-        computationsBuild = computationsSearch = pivotCount = 0;
+    // each point joins its nearest pivot's subset, which widens the range of every other pivot to that subset
+    MemoryCharge held(meter, 2LL*n*sizeof(Point)); // the subsets grow by doubling
+    vector<vector<Point>> subset(node->m);
+    float row[M_MAX];
+    for(int k=0; k<n; k++){
+        int bestIdx = 0;
+        for(int j=0; j<node->m; j++){
+            row[j] = distance(arr[k], node->pivots[j]);
+            stats.computationsBuild++;
+            if(row[j]<row[bestIdx]) bestIdx = j;
+        }
+        for(int i=0; i<node->m; i++){
+            node->low(i, bestIdx) = min(node->low(i, bestIdx), row[i]);
+            node->high(i, bestIdx) = max(node->high(i, bestIdx), row[i]);
+        }
+        subset[bestIdx].push_back(arr[k]);
+    }
+    for(int i=0; i<node->m; i++){
+        int childSize = gnatSize(node->child[i])+(int)subset[i].size();
+        SplitRng childRng = rng.split();
+        node->child[i] = mergeGNAT(node->child[i], subset[i].data(), (int)subset[i].size(), childArity(node->m, childSize, size+n-node->m), childRng);
+    }
+    return node;
+}
 
-        auto build_start = high_resolution_clock::now();
-        GNATNode* root = buildGNAT(points, N_MAX);
-        auto build_end = high_resolution_clock::now();
-        totalBuildTime += duration_cast<microseconds>(build_end - build_start).count();
+void GNATIndex::collect(vector<Point> &out) const{
+    gatherGNAT(root, out);
+}
 
-        Point q;
-        for(int j=0; j<D; j++) q.coords[j] = dist(rng);
 
-        Point bestPt;
-        float bestDist = numeric_limits<float>::infinity();
+// ---------------------- Search ----------------------
+void GNATIndex::search(const Point &q, ResultSet &result) const{
+    search(root, q, result, 0);
+}
 
-        auto search_start = high_resolution_clock::now();
-        search(root, q, bestPt, bestDist);
-        auto search_end = high_resolution_clock::now();
-        totalSearchTime += duration_cast<microseconds>(search_end - search_start).count();
+// bound is a lower bound on the distance from q to anything below node, what is left out when the search runs out
+void GNATIndex::search(const GNATNode* node, const Point &q, ResultSet &result, float bound) const{
+    if(!node) return;
+    if(result.exhausted()){
+        result.leaveOut(bound);
+        return;
+    }
 
-        totalDistBuild += computationsBuild;
-        totalDistSearch += computationsSearch;
-        totalPivots += pivotCount;
+    if(node->isLeaf){
+        for(int i=0; i<node->leafCount; i++){
+            if(result.exhausted()){
+                result.leaveOut(bound);
+                return;
+            }
+            float d = distance(q, node->leafPoints[i]);
+            result.computations++;
+            result.offer(node->leafPoints[i], d);
+        }
+        return;
+    }
 
-        deleteGNAT(root);
+    // scratch lives on the stack, sized by the largest arity, so a query never calls the allocator
+    float distPivot[M_MAX];
+    for(int i=0; i<node->m; i++){
+        distPivot[i] = distance(q, node->pivots[i]);
+        result.computations++;
+        result.offer(node->pivots[i], distPivot[i]);
     }
 
-    cout<<fixed<<setprecision(2);
-    cout<<"\nAveraged over "<<ITERATIONS<<" iterations:"<<endl;
-    cout<<"Average build time: "<<(totalBuildTime/ITERATIONS)<<" microseconds"<<endl;
-    cout<<"Average search time: "<<(totalSearchTime/ITERATIONS)<<" microseconds"<<endl;
-    cout<<"Average distance computations in building: "<<(totalDistBuild/ITERATIONS)<<endl;
-    cout<<"Average distance computations in searching: "<<(totalDistSearch/ITERATIONS)<<endl;
-    cout<<"Average pivots used: "<<(totalPivots/ITERATIONS)<<endl;
-
-    GNATNode* root = buildGNAT(points, N_MAX, 4);
-    Point q;
-    for (int j = 0; j < D; j++) q.coords[j] = dist(rng);
-    Point bestPoint;
-    float bestDist = numeric_limits<float>::infinity();
-    search(root, q, bestPoint, bestDist);
-
-    cout << "\nQuery point:\n"; printPoint(q);
-    cout << "\nNearest neighbor:\n"; printPoint(bestPoint);
-    cout << "\nDistance = " << bestDist << "\n";
-
-    Point bestPointBrute;
-    float bestDistBrute = numeric_limits<float>::infinity();
-    auto search_start_brute = high_resolution_clock::now();
-    for(int i=0; i<N_MAX; i++){
-        float dist = distance(q, points[i]);
-        if(dist < bestDistBrute){
-            bestPointBrute = points[i];
-            bestDistBrute = dist;
+    // nothing in subset j is nearer to q than d(q,p_i) is outside [rangeLow, rangeHigh] of (p_i, subset j), for any i
+    // (range[j][j] is the covering radius of subset j); a subset is skipped while this exceeds r
+    float lower[M_MAX];
+    int order[M_MAX];
+    for(int j=0; j<node->m; j++){
+        lower[j] = bound;
+        for(int i=0; i<node->m; i++){
+            lower[j] = max(lower[j], max(distPivot[i]-node->high(i, j), node->low(i, j)-distPivot[i]));
         }
+        // the subsets are visited nearest lower bound first, so r shrinks before the farther ones are tested
+        int at = j;
+        while(at>0 && lower[order[at-1]]>lower[j]){
+            order[at] = order[at-1];
+            at--;
+        }
+        order[at] = j;
+    }
+    for(int i=0; i<node->m; i++){
+        int j = order[i];
+        if(lower[j] <= result.bound()) search(node->child[j], q, result, lower[j]);
     }
-    auto search_end_brute = high_resolution_clock::now();
-    auto totalSearchTimeBrute = duration_cast<microseconds>(search_end_brute - search_start_brute).count();
-    cout << "\nACTUAL Nearest neighbor:\n"; printPoint(bestPointBrute);
-    cout << "\nACTUAL Distance = " << bestDistBrute << "\n";
-    cout << "\nTime taken = " << totalSearchTimeBrute << " microseconds"<<endl;
 }
 
 
+// ---------------------- Build Report ----------------------
+void GNATIndex::report(BuildReport &report) const{
+    collectReport(root, 0, report);
+}
+
+// walks the tree filling the report, returns the number of points stored below node
+int GNATIndex::collectReport(const GNATNode* node, int depth, BuildReport &report) const{
+    if(!node) return 0;
+    if(node->isLeaf){
+        report.addLeaf(depth, node->leafCount, node->bytes());
+        return node->leafCount;
+    }
+
+    int total = 0, smallest = N_MAX, largest = 0;
+    for(int i=0; i<node->m; i++){
+        int size = collectReport(node->child[i], depth+1, report);
+        total += size;
+        smallest = min(smallest, size);
+        largest = max(largest, size);
+    }
+    float imbalance = (total==0) ? 0 : (float)(largest-smallest)/total;
+    report.addSplit(depth, node->m, node->m, imbalance, node->bytes());
+    return total+node->m;
+}
@@ -0,0 +1,170 @@
+#pragma once
+#include "metric_index.h"
+#include <memory>
+
+#define M 12 // default arity
+#define M_MIN 2 // lower bound on pivots per internal node under the adaptive arity policy
+#define M_MAX 32 // upper bound on pivots per internal node under the adaptive arity policy
+
+
+// ---------------------- Structures ----------------------
+// an internal node's pivots, range tables and children are sized to its arity m, a leaf holds only its points
+struct GNATNode{
+    Point* pivots; // m of them, nullptr in leaves
+    float* rangeLow; // m*m: the range of distances from pivot i to subset j is [rangeLow[i*m+j], rangeHigh[i*m+j]]
+    float* rangeHigh;
+    GNATNode** child; // m of them, nullptr in leaves
+    int m;
+    bool isLeaf;
+    Point* leafPoints; // sized to the leaf's points, nullptr in internal nodes
+    int leafCount;
+
+    explicit GNATNode(int m){ // constructor for internal nodes, the ranges are left for the build to fill
+        this->m = m;
+        isLeaf = false;
+        pivots = new Point[m];
+        rangeLow = new float[m*m];
+        rangeHigh = new float[m*m];
+        child = new GNATNode*[m];
+        for(int i=0; i<m; i++){
+            child[i] = nullptr;
+        }
+        leafPoints = nullptr;
+        leafCount = 0;
+    }
+
+    GNATNode(const Point arr[], int n){ // constructor for leaf nodes
+        m = 0;
+        isLeaf = true;
+        pivots = nullptr;
+        rangeLow = rangeHigh = nullptr;
+        child = nullptr;
+        leafPoints = new Point[n];
+        for(int i=0; i<n; i++){
+            leafPoints[i] = arr[i];
+        }
+        leafCount = n;
+    }
+
+    GNATNode(const GNATNode &other){ // copies the node with arrays of its own, the children are still other's
+        m = other.m;
+        isLeaf = other.isLeaf;
+        pivots = nullptr;
+        rangeLow = rangeHigh = nullptr;
+        child = nullptr;
+        if(!isLeaf){
+            pivots = new Point[m];
+            rangeLow = new float[m*m];
+            rangeHigh = new float[m*m];
+            child = new GNATNode*[m];
+            std::copy(other.pivots, other.pivots+m, pivots);
+            std::copy(other.rangeLow, other.rangeLow+m*m, rangeLow);
+            std::copy(other.rangeHigh, other.rangeHigh+m*m, rangeHigh);
+            std::copy(other.child, other.child+m, child);
+        }
+        leafCount = other.leafCount;
+        leafPoints = nullptr;
+        if(other.leafPoints){
+            leafPoints = new Point[leafCount];
+            std::copy(other.leafPoints, other.leafPoints+leafCount, leafPoints);
+        }
+    }
+    GNATNode& operator=(const GNATNode&) = delete;
+
+    ~GNATNode(){
+        delete []pivots;
+        delete []rangeLow;
+        delete []rangeHigh;
+        delete []child;
+        delete []leafPoints;
+    }
+
+    float& low(int i, int j){
+        return rangeLow[i*m+j];
+    }
+    float& high(int i, int j){
+        return rangeHigh[i*m+j];
+    }
+    float low(int i, int j) const{
+        return rangeLow[i*m+j];
+    }
+    float high(int i, int j) const{
+        return rangeHigh[i*m+j];
+    }
+
+    // bytes a node of arity m (0 for a leaf) holding leafCount leaf points takes
+    static long long bytesFor(int m, int leafCount){
+        return sizeof(GNATNode)+(long long)m*(sizeof(Point)+sizeof(GNATNode*)+2LL*m*sizeof(float))+(long long)leafCount*sizeof(Point);
+    }
+
+    // bytes the node holds, its leaf points included
+    long long bytes() const{
+        return bytesFor(m, leafCount);
+    }
+};
+
+
+// ---------------------- Index ----------------------
+// geometric near-neighbour access tree: every internal node splits its points among m pivots by nearest pivot
+// (a Voronoi-like split) and keeps the range of distances from each pivot to each pivot's subset, its own included
+class GNATIndex : public MetricIndex{
+public:
+    int arity = M; // no of pivots per internal node (at the root when the arity is adaptive), at most M_MAX
+    // 0 - every internal node uses arity pivots
+    // 1 - a child's arity is proportional to its share of the parent's points, clamped to [M_MIN, M_MAX]
+    int arityPolicy = 0;
+    // 0 - pivots picked uniformly at random
+    // 1 - pivots picked greedily farthest-first from a random sample of 3*m candidates
+    int pivotPolicy = 0;
+    // a split is rejected and its pivots chosen again when (largest-smallest subset)/(points in the subsets) exceeds
+    // this; 1 accepts every split
+    float maxImbalance = 1.0f;
+    int maxResamples = 8; // after this many rejections the last split is accepted anyway
+
+    GNATNode* root = nullptr;
+
+    GNATIndex(int metricType=2, int leafSize=4) : MetricIndex(metricType, leafSize) {}
+    GNATIndex(const GNATIndex &other); // deep copy
+    GNATIndex& operator=(const GNATIndex&) = delete;
+    ~GNATIndex();
+
+    const char* name() const override{
+        return "GNAT";
+    }
+
+    void build(const Point arr[], int n) override;
+    void search(const Point &q, ResultSet &result) const override;
+    void report(BuildReport &report) const override;
+    void collect(std::vector<Point> &out) const override;
+
+    MetricIndex* clone() const override{
+        return new GNATIndex(*this);
+    }
+
+    // the points of other go to their nearest pivot, widening the range tables on the way down; a subtree is
+    // only rebuilt where they reach a leaf or where they outnumber the points already below it
+    void merge(const MetricIndex &other) override;
+
+private:
+    // scratch of a build, sized to its points once and shared by every level of the recursion: a node works on the
+    // range [first, first+n) of each array, its children on the parts of that range it assigns the points to
+    struct BuildScratch{
+        std::vector<Point> points; // the points being built over
+        std::vector<Point> spare; // the subsets are written here, then copied back in place
+        std::vector<int> owner; // subset each point was assigned to
+        std::unique_ptr<bool[]> chosen; // the points picked as pivots
+    };
+    BuildScratch scratch;
+    MemoryMeter meter; // what build and merge hold, charged against memoryBudget
+
+    // builds over arr[0..n) through the scratch, reserving and then releasing it
+    GNATNode* buildFrom(const Point arr[], int n, int arity, SplitRng &rng);
+    GNATNode* buildGNAT(int first, int n, int arity, SplitRng &rng);
+    void deleteCounted(GNATNode* node);
+    GNATNode* mergeGNAT(GNATNode* node, const Point arr[], int n, int arity, SplitRng &rng);
+    void pickRandomPivots(const Point arr[], int n, int m, bool chosen[], Point pivots[], SplitRng &rng);
+    void pickFarthestFirstPivots(const Point arr[], int n, int m, bool chosen[], Point pivots[], SplitRng &rng);
+    int childArity(int m, int size, int n) const;
+    void search(const GNATNode* node, const Point &q, ResultSet &result, float bound) const;
+    int collectReport(const GNATNode* node, int depth, BuildReport &report) const;
+};
@@ -0,0 +1,147 @@
+#include "GroundTruth.h"
+#include "Scan.h"
+#include <fstream>
+#include <sys/stat.h>
+using namespace std;
+
+#define TRUTH_MAGIC 0x31525447 // "GTR1", leads a ground truth file
+#define TRUTH_SLACK 1e-6 // rounding allowed to an exact index in checkAccuracy
+
+
+// ---------------------- Ground Truth ----------------------
+// FNV-1a over the bytes
+static unsigned long long hashBytes(unsigned long long h, const void* data, size_t bytes){
+    const unsigned char* p = (const unsigned char*)data;
+    for(size_t i=0; i<bytes; i++){
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+struct TruthHeader{
+    int magic;
+    int dims;
+    int k;
+    int metricType;
+    int points;
+    int queries;
+    unsigned long long hash;
+};
+
+static bool readTruth(const string &path, const TruthHeader &expected, GroundTruth &truth){
+    ifstream in(path, ios::binary);
+    TruthHeader header;
+    if(!in.read((char*)&header, sizeof(header))) return false;
+    if(header.magic!=expected.magic || header.dims!=expected.dims || header.k!=expected.k || header.metricType!=expected.metricType ||
+        header.points!=expected.points || header.queries!=expected.queries || header.hash!=expected.hash) return false;
+    truth.neighbors.resize(header.queries);
+    for(vector<TrueNeighbor> &found : truth.neighbors){
+        int size;
+        if(!in.read((char*)&size, sizeof(size)) || size<0 || size>header.k) return false;
+        found.resize(size);
+        if(!in.read((char*)found.data(), size*sizeof(TrueNeighbor))) return false;
+    }
+    return true;
+}
+
+// written to a temporary name and renamed, so a run that stops half way leaves no truncated file behind
+static void writeTruth(const string &path, const TruthHeader &header, const GroundTruth &truth){
+    string temporary = path+".tmp";
+    {
+        ofstream out(temporary, ios::binary);
+        out.write((const char*)&header, sizeof(header));
+        for(const vector<TrueNeighbor> &found : truth.neighbors){
+            int size = (int)found.size();
+            out.write((const char*)&size, sizeof(size));
+            out.write((const char*)found.data(), size*sizeof(TrueNeighbor));
+        }
+        if(!out) return; // the cache is only an aid, the truth is still returned
+    }
+    rename(temporary.c_str(), path.c_str());
+}
+
+GroundTruth groundTruth(const Point points[], int n, const Point queries[], int count, int k, int metricType, const string &cacheDir){
+    GroundTruth truth;
+    truth.k = k;
+    truth.metricType = metricType;
+
+    TruthHeader header = {TRUTH_MAGIC, D, k, metricType, n, count, 0xcbf29ce484222325ULL};
+    header.hash = hashBytes(header.hash, points, (size_t)n*sizeof(Point));
+    header.hash = hashBytes(header.hash, queries, (size_t)count*sizeof(Point));
+    string path;
+    if(!cacheDir.empty()){
+        mkdir(cacheDir.c_str(), 0755);
+        char name[64];
+        snprintf(name, sizeof(name), "/truth-%016llx-k%d-m%d.bin", header.hash, k, metricType);
+        path = cacheDir+name;
+        if(readTruth(path, header, truth)) return truth;
+    }
+
+    LinearScan scan(metricType);
+    scan.build(points, n);
+    vector<ResultSet> results(count, ResultSet(k));
+    scan.searchBatch(queries, results.data(), count);
+    truth.neighbors.resize(count);
+    for(int i=0; i<count; i++){
+        for(const Neighbor &neighbor : results[i].sorted()) truth.neighbors[i].push_back({neighbor.point.id, neighbor.dist});
+    }
+    if(!path.empty()) writeTruth(path, header, truth);
+    return truth;
+}
+
+
+// ---------------------- Verification ----------------------
+Accuracy measureAccuracy(const GroundTruth &truth, const ResultSet results[], int count){
+    if(count!=(int)truth.neighbors.size()) throw invalid_argument("measureAccuracy: "+to_string(count)+" answers to a ground truth of "+to_string(truth.neighbors.size())+" queries");
+    Accuracy accuracy;
+    double recallSum = 0, ratioSum = 0;
+    for(int i=0; i<count; i++){
+        const vector<TrueNeighbor> &exact = truth.neighbors[i];
+        if(exact.empty()) continue;
+        vector<Neighbor> found = results[i].sorted();
+        // a point returned more than once is counted once, the copies leave their ranks empty
+        vector<Neighbor> unique;
+        for(const Neighbor &neighbor : found){
+            bool seen = false;
+            for(const Neighbor &kept : unique) seen = seen || kept.point.id==neighbor.point.id;
+            if(!seen) unique.push_back(neighbor);
+        }
+        if(unique.size()<found.size()) accuracy.duplicates++;
+        found.swap(unique);
+        float kth = exact.back().dist;
+        int hits = 0;
+        double ratio = 0;
+        for(int rank=0; rank<(int)exact.size(); rank++){
+            if(rank>=(int)found.size()){
+                ratio += RATIO_CAP;
+                continue;
+            }
+            if(found[rank].dist<=kth) hits++;
+            if(exact[rank].dist>0) ratio += min((double)found[rank].dist/exact[rank].dist, RATIO_CAP);
+            else ratio += (found[rank].dist>0) ? RATIO_CAP : 1;
+        }
+        ratio /= exact.size();
+        recallSum += (double)hits/exact.size();
+        ratioSum += ratio;
+        accuracy.worstRatio = max(accuracy.worstRatio, ratio);
+        accuracy.queries++;
+    }
+    if(accuracy.queries>0){
+        accuracy.recall = recallSum/accuracy.queries;
+        accuracy.distanceRatio = ratioSum/accuracy.queries;
+    }
+    else accuracy.recall = accuracy.distanceRatio = accuracy.worstRatio = 1; // nothing to miss
+    return accuracy;
+}
+
+bool checkAccuracy(const char* name, const Accuracy &accuracy, const AccuracyFloor &floor){
+    bool passed = accuracy.recall>=floor.minRecall-TRUTH_SLACK && accuracy.distanceRatio<=floor.maxRatio+TRUTH_SLACK &&
+        accuracy.duplicates==0;
+    cout<<fixed<<setprecision(4)<<name<<": recall "<<accuracy.recall<<" (at least "<<floor.minRecall<<"), distance ratio "
+        <<accuracy.distanceRatio<<" (at most "<<floor.maxRatio<<"), worst query "<<accuracy.worstRatio;
+    if(accuracy.duplicates) cout<<", "<<accuracy.duplicates<<" answers with a point twice";
+    cout<<(passed ? "" : "  REGRESSION")<<endl;
+    cout<<setprecision(2);
+    return passed;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "metric_index.h"
+#include <string>
+
+#define RATIO_CAP 10.0 // distance ratio counted for a rank an answer left empty, or that should have been at distance 0
+
+
+// ---------------------- Ground Truth ----------------------
+struct TrueNeighbor{
+    int id;
+    float dist;
+};
+
+// the exact k nearest neighbours of every query of a set, nearest first
+struct GroundTruth{
+    int k = 0;
+    int metricType = 0;
+    std::vector<std::vector<TrueNeighbor>> neighbors; // neighbors[i] of queries[i], fewer than k when there are fewer points
+};
+
+// computed by LinearScan::searchBatch on every hardware thread and kept in cacheDir (made if missing), in a file named
+// by a hash of the points, the queries, k and the metric; a later call over the same inputs reads the file instead
+// cacheDir "" computes it every time
+GroundTruth groundTruth(const Point points[], int n, const Point queries[], int count, int k, int metricType, const std::string &cacheDir);
+
+
+// ---------------------- Verification ----------------------
+// how close the answers of an index to queries[0..count) come to their ground truth
+// recall - share of the true neighbours found; a point found no farther than the true k-th counts, so a tie broken the
+//          other way is not a miss
+// distanceRatio - mean over the queries and ranks of the distance found over the true one, 1 for exact answers
+struct Accuracy{
+    double recall = 0;
+    double distanceRatio = 0;
+    double worstRatio = 0; // of the query answered worst, its mean over the ranks
+    int queries = 0;
+    int duplicates = 0; // answers holding some point more than once, counted once towards recall, and always a failure
+};
+
+// results[i] answers query i of truth, count must be the queries of truth (invalid_argument otherwise); with no query
+// that has a true neighbour, recall and ratio are 1
+Accuracy measureAccuracy(const GroundTruth &truth, const ResultSet results[], int count);
+
+// what an index must keep to pass: recall at least minRecall, distanceRatio at most maxRatio
+// exact indices are held to 1 and 1, approximate modes to the floor they were measured at, less a margin
+struct AccuracyFloor{
+    double minRecall = 1;
+    double maxRatio = 1;
+};
+
+// prints accuracy against the floor, with the verdict; returns whether it passed, never with duplicates
+bool checkAccuracy(const char* name, const Accuracy &accuracy, const AccuracyFloor &floor);
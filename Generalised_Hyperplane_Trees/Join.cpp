@@ -0,0 +1,454 @@
+#include "Join.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+using namespace std;
+
+
+// ---------------------- Join Tree ----------------------
+int JoinTree::addNode(const Point own[], int count){
+    JoinNode node;
+    node.first = (int)points.size();
+    node.count = count;
+    node.childFirst = node.childCount = 0;
+    node.radius = 0;
+    node.size = count;
+    for(int i=0; i<count; i++){
+        points.push_back(own[i]);
+    }
+    nodes.push_back(node);
+    return (int)nodes.size()-1;
+}
+
+// inherited: pivotA is the parent's pivot and already belongs to an ancestor (below the root of an MBT)
+int JoinTree::addGHT(const TreeNode* node, bool inherited, bool reusing){
+    if(node->isLeaf) return addNode(node->bucket, node->bucketSize);
+
+    Point own[2] = {node->pivotA, node->pivotB};
+    int at = inherited ? addNode(own+1, 1) : addNode(own, node->ball ? 1 : 2); // a vantage point split stores pivotA alone
+    int kids[2];
+    int count = 0;
+    if(node->left) kids[count++] = addGHT(node->left, reusing, reusing);
+    if(node->right) kids[count++] = addGHT(node->right, reusing, reusing);
+    link(at, kids, count);
+    return at;
+}
+
+int JoinTree::addGNAT(const GNATNode* node){
+    if(node->isLeaf) return addNode(node->leafPoints, node->leafCount);
+
+    int at = addNode(node->pivots, node->m);
+    int kids[M_MAX];
+    int count = 0;
+    for(int i=0; i<node->m; i++){
+        if(node->child[i]) kids[count++] = addGNAT(node->child[i]);
+    }
+    link(at, kids, count);
+    return at;
+}
+
+void JoinTree::link(int at, const int kids[], int count){
+    nodes[at].childFirst = (int)children.size();
+    nodes[at].childCount = count;
+    for(int i=0; i<count; i++){
+        children.push_back(kids[i]);
+        nodes[at].size += nodes[kids[i]].size;
+    }
+}
+
+// widens [nearest, farthest] to the distances from center to the points in the subtree of node at
+void JoinTree::cover(int at, const Point &center, float &nearest, float &farthest){
+    const JoinNode &node = nodes[at];
+    for(int i=0; i<node.count; i++){
+        float d = distance(center, points[node.first+i], metricType);
+        computationsBuild++;
+        nearest = min(nearest, d);
+        farthest = max(farthest, d);
+    }
+    for(int c=0; c<node.childCount; c++){
+        cover(children[node.childFirst+c], center, nearest, farthest);
+    }
+}
+
+// every node is centred on its first own point
+void JoinTree::finish(){
+    centerDist.assign(points.size(), 0);
+    for(int at=0; at<(int)nodes.size(); at++){
+        JoinNode &node = nodes[at];
+        node.center = points[node.first];
+        node.radius = 0;
+        if(at==0) node.parentNear = node.parentFar = 0;
+        for(int i=1; i<node.count; i++){
+            centerDist[node.first+i] = distance(node.center, points[node.first+i], metricType);
+            node.radius = max(node.radius, centerDist[node.first+i]);
+            computationsBuild++;
+        }
+        for(int c=0; c<node.childCount; c++){
+            JoinNode &child = nodes[children[node.childFirst+c]];
+            child.parentNear = numeric_limits<float>::infinity();
+            child.parentFar = 0;
+            cover(children[node.childFirst+c], node.center, child.parentNear, child.parentFar);
+            node.radius = max(node.radius, child.parentFar);
+        }
+    }
+}
+
+JoinTree::JoinTree(const GHTIndex &index) : metricType(index.metricType){
+    if(index.root){
+        addGHT(index.root, false, index.inheritsPivots());
+        finish();
+    }
+}
+
+JoinTree::JoinTree(const GNATIndex &index) : metricType(index.metricType){
+    if(index.root){
+        addGNAT(index.root);
+        finish();
+    }
+}
+
+
+// ---------------------- Joins ----------------------
+// the query side A is cut into units that workers take in turn: a subtree, or just the own points of a node
+// above the subtrees. A unit is joined against the whole of B, and only its own worker writes the bounds and
+// neighbours of its points (in a self nearest join, each worker writes copies of its own), so the workers share
+// nothing but the unit counter
+struct JoinUnit{
+    int at;
+    bool ownOnly;
+};
+
+static vector<JoinUnit> cutUnits(const JoinTree &A, int wanted){
+    vector<JoinUnit> units;
+    if(A.nodes.empty()) return units;
+    units.push_back({0, false});
+    while((int)units.size()<wanted){
+        int largest = -1;
+        for(int i=0; i<(int)units.size(); i++){
+            const JoinNode &node = A.nodes[units[i].at];
+            if(units[i].ownOnly || node.childCount==0) continue;
+            if(largest<0 || node.size>A.nodes[units[largest].at].size) largest = i;
+        }
+        if(largest<0) break;
+        const JoinNode &node = A.nodes[units[largest].at];
+        units[largest].ownOnly = true;
+        for(int c=0; c<node.childCount; c++){
+            units.push_back({A.children[node.childFirst+c], false});
+        }
+    }
+    return units;
+}
+
+// runs work(unit, worker) for every unit over the given no of threads (0 - one per hardware thread)
+template<typename Work>
+static void runUnits(int unitCount, int threads, Work work){
+    atomic<int> next(0);
+    auto worker = [&](int w){
+        for(int u=next++; u<unitCount; u=next++){
+            work(u, w);
+        }
+    };
+    if(threads<=1){
+        worker(0);
+        return;
+    }
+    vector<thread> pool;
+    for(int w=0; w<threads; w++){
+        pool.emplace_back(worker, w);
+    }
+    for(thread &t : pool){
+        t.join();
+    }
+}
+
+static int threadCount(int threads){
+    if(threads>0) return threads;
+    return max(1, (int)thread::hardware_concurrency());
+}
+
+// one worker's walk over a unit of A against B
+// a node pair is pruned when no point of the A node can lie within its radius of any point of the B node, going
+// by the distance between the centres and the covering radii; otherwise the node with the larger ball is split into
+// its own points, each searched against the other node, and its children. A point's distance to its node's centre
+// gives the lower bound |d(a,c)-d(b,c)| <= d(a,b) that skips most of the distances between the own points of a pair,
+// and a child's distances from its parent's centre bound it before its own centre is measured
+// range join - the radius is r throughout
+// nearest join - the radius of a point is the distance to its nearest neighbour so far, and that of a node of A
+//                the largest radius of a point in its subtree (bound), both only shrink as the walk goes on
+// self join - A and B are one tree and a pair of positions i<j is only taken up from the side of i, so a subtree of B
+//             holding no point after those of A is never entered; in a nearest join the distance goes to both points,
+//             and a pair is pruned only when it can improve neither side
+class JoinWalk{
+public:
+    const JoinTree &A, &B;
+    bool self;
+    bool nearestMode;
+    float r;
+    std::vector<JoinPair> pairs; // range join results
+    JoinPair* nearest = nullptr; // by position in A.points
+    float* bound = nullptr; // by node of A
+    long long computations = 0;
+
+    JoinWalk(const JoinTree &A, const JoinTree &B, bool self, bool nearestMode, float r) : A(A), B(B), self(self), nearestMode(nearestMode), r(r) {}
+
+    // between A.points[i] and B.points[j]; in a self join a point is 0 from itself without measuring
+    float dist(int i, int j){
+        if(self && i==j) return 0;
+        computations++;
+        return distance(A.points[i], B.points[j], A.metricType);
+    }
+
+    // the radius within which a pair of points, a point and a node, or two nodes (of A, then of B) matter
+    float reach(int i, int j) const{
+        if(!nearestMode) return r;
+        return self ? max(nearest[i].dist, nearest[j].dist) : nearest[i].dist;
+    }
+    float reachToNode(int i, int y) const{
+        if(!nearestMode) return r;
+        return self ? max(nearest[i].dist, bound[y]) : nearest[i].dist;
+    }
+    float reachFromNode(int x, int j) const{
+        if(!nearestMode) return r;
+        return self ? max(bound[x], nearest[j].dist) : bound[x];
+    }
+    float reachNodes(int x, int y) const{
+        if(!nearestMode) return r;
+        return self ? max(bound[x], bound[y]) : bound[x];
+    }
+
+    // position of the last point in the subtree of node
+    static int last(const JoinNode &node){
+        return node.first+node.size-1;
+    }
+
+    // no point of child is nearer than this to one d away from the centre of its parent
+    static float gap(const JoinNode &child, float d){
+        return max(d-child.parentFar, child.parentNear-d);
+    }
+
+    // A.points[i] and B.points[j] are d apart
+    void offer(int i, int j, float d){
+        const Point &a = A.points[i], &b = B.points[j];
+        if(nearestMode){
+            if(self && i==j) return;
+            if(d<nearest[i].dist){
+                nearest[i].b = b.id;
+                nearest[i].dist = d;
+            }
+            if(self && d<nearest[j].dist){
+                nearest[j].b = a.id;
+                nearest[j].dist = d;
+            }
+        }
+        // a self join also measures some pairs out of order to find its way, those are reported from the other side
+        else if(d<=r && !(self && i>=j)) pairs.push_back(self ? JoinPair{min(a.id, b.id), max(a.id, b.id), d} : JoinPair{a.id, b.id, d});
+    }
+
+    // recomputes the bound of node x from its own points and the bounds of its children; it only has to stay above the
+    // final radius of every point in the subtree, so besides the largest radius so far, an own point p bounds them all,
+    // each having p within d(p,c)+radius and so a neighbour within that plus the radius of p. In a self join the centre
+    // also has a neighbour in each child, parentNear away
+    void tighten(int x){
+        if(!nearestMode) return;
+        const JoinNode &node = A.nodes[x];
+        float worst = 0, best = numeric_limits<float>::infinity();
+        for(int i=0; i<node.count; i++){
+            worst = max(worst, nearest[node.first+i].dist);
+            best = min(best, nearest[node.first+i].dist+A.centerDist[node.first+i]);
+        }
+        for(int c=0; c<node.childCount; c++){
+            int child = A.children[node.childFirst+c];
+            worst = max(worst, bound[child]);
+            if(self) best = min(best, A.nodes[child].parentNear);
+        }
+        bound[x] = min(worst, best+node.radius);
+    }
+
+    // before a self nearest join: the distances from each centre to the other own points of its node are known, so
+    // every point starts with a neighbour there and every node with a bound, and the walk prunes from its first pair on
+    void seed(){
+        for(int x=(int)A.nodes.size()-1; x>=0; x--){ // children come after their parents
+            const JoinNode &node = A.nodes[x];
+            for(int i=1; i<node.count; i++){
+                offer(node.first, node.first+i, A.centerDist[node.first+i]);
+            }
+            tighten(x);
+        }
+    }
+
+    // A.points[i] against the subtree of B at y, whose centre is d away; children are visited nearest centre first
+    void pointA(int i, int y, float d){
+        const JoinNode &node = B.nodes[y];
+        offer(i, node.first, d);
+        for(int j=1; j<node.count; j++){
+            int b = node.first+j;
+            if((self && b<=i) || fabsf(d-B.centerDist[b])>reach(i, b)) continue;
+            offer(i, b, dist(i, b));
+        }
+
+        int kids[M_MAX], order[M_MAX];
+        float dc[M_MAX];
+        int count = 0;
+        for(int c=0; c<node.childCount; c++){
+            int child = B.children[node.childFirst+c];
+            if((self && last(B.nodes[child])<=i) || gap(B.nodes[child], d)>reachToNode(i, child)) continue;
+            kids[count] = child;
+            dc[count] = dist(i, B.nodes[child].first);
+            order[count] = count;
+            count++;
+        }
+        sort(order, order+count, [&](int u, int v){ return dc[u]<dc[v]; });
+        for(int k=0; k<count; k++){
+            int c = order[k];
+            if(dc[c]-B.nodes[kids[c]].radius<=reachToNode(i, kids[c])) pointA(i, kids[c], dc[c]);
+        }
+        if(self) tighten(y);
+    }
+
+    // B.points[j] against the subtree of A at x, whose centre is d away
+    void pointB(int x, int j, float d){
+        const JoinNode &node = A.nodes[x];
+        offer(node.first, j, d);
+        for(int i=1; i<node.count; i++){
+            int a = node.first+i;
+            if(self && a>=j) break;
+            if(fabsf(d-A.centerDist[a])>reach(a, j)) continue;
+            offer(a, j, dist(a, j));
+        }
+        for(int c=0; c<node.childCount; c++){
+            int child = A.children[node.childFirst+c];
+            const JoinNode &kid = A.nodes[child];
+            if(self && kid.first>=j) break;
+            if(gap(kid, d)>reachFromNode(child, j)) continue;
+            float dc = dist(kid.first, j);
+            if(dc-kid.radius<=reachFromNode(child, j)) pointB(child, j, dc);
+        }
+        tighten(x);
+    }
+
+    // the subtrees of A at x and of B at y, whose centres are d apart
+    void dual(int x, int y, float d){
+        const JoinNode &nx = A.nodes[x];
+        const JoinNode &ny = B.nodes[y];
+        if(d-nx.radius-ny.radius>reachNodes(x, y)) return;
+
+        if(nx.childCount==0 && ny.childCount==0){
+            // d(a,b) >= d-d(a,cx)-d(b,cy) and |d(a,cx)-d(b,cy)|-d; within one leaf, the centre is d(b,c) from b
+            for(int i=0; i<nx.count; i++){
+                int a = nx.first+i;
+                float da = A.centerDist[a];
+                for(int j=self ? max(0, a+1-ny.first) : 0; j<ny.count; j++){
+                    int b = ny.first+j;
+                    float db = B.centerDist[b];
+                    if(self && x==y && i==0) offer(a, b, db);
+                    else if(max(d-da-db, fabsf(da-db)-d)<=reach(a, b)) offer(a, b, dist(a, b));
+                }
+            }
+        }
+        else if(ny.childCount>0 && (nx.childCount==0 || ny.radius>=nx.radius)){
+            for(int j=0; j<ny.count; j++){
+                int b = ny.first+j;
+                if(self && nx.first>=b) continue;
+                float db = (j==0) ? d : (self && x==y) ? B.centerDist[b] : dist(nx.first, b);
+                if(db-nx.radius<=reachFromNode(x, b)) pointB(x, b, db);
+            }
+            int kids[M_MAX], order[M_MAX];
+            float dc[M_MAX];
+            int count = 0;
+            for(int c=0; c<ny.childCount; c++){
+                int child = B.children[ny.childFirst+c];
+                if((self && last(B.nodes[child])<=nx.first) || gap(B.nodes[child], d)-nx.radius>reachNodes(x, child)) continue;
+                kids[count] = child;
+                dc[count] = dist(nx.first, B.nodes[child].first);
+                order[count] = count;
+                count++;
+            }
+            sort(order, order+count, [&](int u, int v){ return dc[u]<dc[v]; });
+            for(int k=0; k<count; k++){
+                dual(x, kids[order[k]], dc[order[k]]);
+            }
+        }
+        else{
+            for(int i=0; i<nx.count; i++){
+                int a = nx.first+i;
+                if(self && last(ny)<=a) break;
+                float da = (i==0) ? d : dist(a, ny.first);
+                if(da-ny.radius<=reachToNode(a, y)) pointA(a, y, da);
+            }
+            for(int c=0; c<nx.childCount; c++){
+                int child = A.children[nx.childFirst+c];
+                const JoinNode &kid = A.nodes[child];
+                if(self && last(ny)<=kid.first) break;
+                if(gap(kid, d)-ny.radius>reachNodes(child, y)) continue;
+                dual(child, y, dist(kid.first, ny.first));
+            }
+        }
+        tighten(x);
+        if(self) tighten(y);
+    }
+
+    // a unit of A against the whole of B
+    void run(const JoinUnit &unit){
+        const JoinNode &node = A.nodes[unit.at];
+        if(!unit.ownOnly){
+            dual(unit.at, 0, dist(node.first, 0));
+            return;
+        }
+        for(int i=0; i<node.count; i++){
+            pointA(node.first+i, 0, dist(node.first+i, 0));
+        }
+    }
+};
+
+long long similarityJoin(const JoinTree &A, const JoinTree &B, float r, bool self, vector<JoinPair> &pairs, int threads){
+    pairs.clear();
+    if(A.nodes.empty() || B.nodes.empty()) return 0;
+    threads = threadCount(threads);
+    vector<JoinUnit> units = cutUnits(A, 8*threads);
+    vector<JoinWalk> workers(threads, JoinWalk(A, B, self, false, r));
+    runUnits((int)units.size(), threads, [&](int u, int w){
+        workers[w].run(units[u]);
+    });
+
+    long long computations = 0;
+    for(JoinWalk &walk : workers){
+        pairs.insert(pairs.end(), walk.pairs.begin(), walk.pairs.end());
+        computations += walk.computations;
+    }
+    return computations;
+}
+
+long long allNearestNeighbours(const JoinTree &A, const JoinTree &B, bool self, vector<JoinPair> &nearest, int threads){
+    const float inf = numeric_limits<float>::infinity();
+    nearest.resize(A.points.size());
+    for(int i=0; i<(int)A.points.size(); i++){
+        nearest[i] = {A.points[i].id, -1, inf};
+    }
+    if(A.nodes.empty() || B.nodes.empty()) return 0;
+    threads = threadCount(threads);
+    vector<JoinUnit> units = cutUnits(A, 8*threads);
+    // a self join also finds neighbours for points outside a worker's units, so every worker keeps neighbours and
+    // bounds of its own there, and the nearest of them are taken at the end
+    vector<vector<JoinPair>> found(self ? threads-1 : 0, nearest);
+    vector<vector<float>> bounds(self ? threads : 1, vector<float>(A.nodes.size(), inf));
+    vector<JoinWalk> workers(threads, JoinWalk(A, B, self, true, inf));
+    for(int w=0; w<threads; w++){
+        workers[w].nearest = (self && w>0) ? found[w-1].data() : nearest.data();
+        workers[w].bound = bounds[self ? w : 0].data();
+        if(self) workers[w].seed();
+    }
+    runUnits((int)units.size(), threads, [&](int u, int w){
+        workers[w].run(units[u]);
+    });
+
+    for(const vector<JoinPair> &other : found){
+        for(int i=0; i<(int)nearest.size(); i++){
+            if(other[i].dist<nearest[i].dist) nearest[i] = other[i];
+        }
+    }
+    long long computations = 0;
+    for(JoinWalk &walk : workers){
+        computations += walk.computations;
+    }
+    return computations;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "GHT.h"
+#include "GNAT.h"
+
+
+// ---------------------- Join Tree ----------------------
+// a built GHT or GNAT seen as a hierarchy of balls, for joins that walk two trees at once
+// every node owns a few points (its pivots, or a leaf's bucket) and its first own point is the centre of a ball
+// covering its whole subtree; the points of a subtree are contiguous, its own points first, then its children's in order
+struct JoinNode{
+    Point center;
+    float radius;
+    float parentNear, parentFar; // nearest and farthest distance of the subtree from the centre of the parent, 0 at the root
+    int first, count; // own points: points[first..first+count)
+    int childFirst, childCount; // children: children[childFirst..childFirst+childCount)
+    int size; // points in the subtree
+};
+
+class JoinTree{
+public:
+    int metricType;
+    std::vector<JoinNode> nodes; // nodes[0] is the root
+    std::vector<int> children;
+    std::vector<Point> points;
+    std::vector<float> centerDist; // distance of points[i] to the centre of the node owning it
+    long long computationsBuild = 0; // distance computations spent on the covering radii
+
+    explicit JoinTree(const GHTIndex &index);
+    explicit JoinTree(const GNATIndex &index);
+
+private:
+    int addNode(const Point own[], int count);
+    int addGHT(const TreeNode* node, bool inherited, bool reusing);
+    int addGNAT(const GNATNode* node);
+    void link(int at, const int kids[], int count);
+    void cover(int at, const Point &center, float &nearest, float &farthest);
+    void finish();
+};
+
+
+// ---------------------- Joins ----------------------
+struct JoinPair{
+    int a, b; // ids of the two points
+    float dist;
+};
+
+// every pair (a from A, b from B) with d(a,b) <= r
+// with self set A and B must be the same tree, and each unordered pair is taken up from one side and reported once,
+// with a.id < b.id
+// returns the distance computations made
+long long similarityJoin(const JoinTree &A, const JoinTree &B, float r, bool self, std::vector<JoinPair> &pairs, int threads=0);
+
+// the nearest point of B for every point of A, nearest[i] for A.points[i] (b=-1 and dist=inf if none)
+// with self set a point is not its own neighbour, and a pair is taken up from one side, the distance going to both points
+// returns the distance computations made
+long long allNearestNeighbours(const JoinTree &A, const JoinTree &B, bool self, std::vector<JoinPair> &nearest, int threads=0);
@@ -0,0 +1,203 @@
+#include "LSM.h"
+#include <algorithm>
+using namespace std;
+
+
+LSMIndex::LSMIndex(MetricIndex* prototype) : MetricIndex(prototype->metricType, prototype->leafSize), prototype(prototype){
+    prototype->build(nullptr, 0); // only its settings are needed
+    live = make_shared<const Runs>();
+    start();
+}
+
+LSMIndex::LSMIndex(const LSMIndex &other) : MetricIndex(other.metricType, other.leafSize), prototype(other.prototype->clone()){
+    other.waitIdle(); // other keeps its merge error, if any, to report itself
+    shared_ptr<const Runs> runs = atomic_load(&other.live);
+    shared_ptr<Runs> copy = make_shared<Runs>();
+    for(const Run &run : *runs){
+        copy->push_back({shared_ptr<MetricIndex>(run.index->clone()), run.level});
+    }
+    {
+        lock_guard<mutex> guard(other.lock);
+        stats = other.stats;
+    }
+    live = copy;
+    start();
+}
+
+LSMIndex::~LSMIndex(){
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    merger.join();
+}
+
+void LSMIndex::start(){
+    merger = thread(&LSMIndex::mergeLoop, this);
+}
+
+// the largest indices are searched first, they are the likeliest to tighten the bound
+void LSMIndex::publish(const shared_ptr<const Runs> &runs){
+    shared_ptr<Runs> sorted = make_shared<Runs>(*runs);
+    stable_sort(sorted->begin(), sorted->end(), [](const Run &x, const Run &y){ return x.level>y.level; });
+    atomic_store(&live, shared_ptr<const Runs>(sorted));
+}
+
+
+// ---------------------- Build ----------------------
+void LSMIndex::build(const Point arr[], int n){
+    {
+        lock_guard<mutex> guard(lock);
+        stats = IndexStats();
+        failure = nullptr; // of indices about to be dropped
+        publish(make_shared<const Runs>());
+    }
+    insert(arr, n);
+    wait();
+}
+
+void LSMIndex::insert(const Point arr[], int n){
+    {
+        lock_guard<mutex> guard(lock);
+        rethrowFailure();
+    }
+    if(n<=0) return;
+    shared_ptr<MetricIndex> index(prototype->clone());
+    index->build(arr, n);
+    {
+        lock_guard<mutex> guard(lock);
+        shared_ptr<Runs> runs = make_shared<Runs>(*live);
+        runs->push_back({index, 0});
+        stats.computationsBuild += index->stats.computationsBuild;
+        stats.pivotCount += index->stats.pivotCount;
+        stats.resampleCount += index->stats.resampleCount;
+        stats.pointCount += n;
+        publish(runs);
+    }
+    wake.notify_one();
+}
+
+void LSMIndex::merge(const MetricIndex &other){
+    vector<Point> incoming;
+    other.collect(incoming);
+    insert(incoming.data(), (int)incoming.size());
+}
+
+
+// ---------------------- Merging ----------------------
+// two indices of the lowest level that has two, as long as their points fit in one index
+bool LSMIndex::pickMerge(const Runs &runs, int &a, int &b) const{
+    bool found = false;
+    for(int i=0; i<(int)runs.size(); i++){
+        for(int j=i+1; j<(int)runs.size(); j++){
+            if(runs[i].level!=runs[j].level) continue;
+            if(runs[i].index->stats.pointCount+runs[j].index->stats.pointCount>N_MAX) continue;
+            if(found && runs[i].level>=runs[a].level) continue;
+            a = i;
+            b = j;
+            found = true;
+        }
+    }
+    if(found && runs[a].index->stats.pointCount<runs[b].index->stats.pointCount) swap(a, b);
+    return found;
+}
+
+// the larger index of a pair is cloned and the smaller merged into the clone, outside the lock, while queries
+// keep using the pair; the result then takes the pair's place unless build dropped them in the meantime
+void LSMIndex::mergeLoop(){
+    unique_lock<mutex> guard(lock);
+    while(!stopping){
+        int a, b;
+        if(failure || !pickMerge(*live, a, b)){
+            merging = false;
+            idle.notify_all();
+            wake.wait(guard);
+            continue;
+        }
+        merging = true;
+        Run first = (*live)[a];
+        Run second = (*live)[b];
+        guard.unlock();
+
+        shared_ptr<MetricIndex> merged;
+        long long before = 0;
+        try{
+            merged.reset(first.index->clone());
+            before = merged->stats.computationsBuild;
+            merged->merge(*second.index);
+        }
+        catch(...){
+            guard.lock();
+            failure = current_exception(); // the pair stays live as it was
+            continue;
+        }
+
+        guard.lock();
+        shared_ptr<Runs> runs = make_shared<Runs>();
+        int found = 0;
+        for(const Run &run : *live){
+            if(run.index==first.index || run.index==second.index) found++;
+            else runs->push_back(run);
+        }
+        if(found==2){
+            runs->push_back({merged, first.level+1});
+            stats.computationsBuild += merged->stats.computationsBuild-before;
+            stats.pivotCount += merged->stats.pivotCount-first.index->stats.pivotCount-second.index->stats.pivotCount;
+            publish(runs);
+        }
+    }
+    merging = false;
+    idle.notify_all();
+}
+
+void LSMIndex::waitIdle() const{
+    unique_lock<mutex> guard(lock);
+    idle.wait(guard, [&]{
+        int a, b;
+        return stopping || (!merging && (failure || !pickMerge(*live, a, b)));
+    });
+}
+
+void LSMIndex::wait() const{
+    waitIdle();
+    lock_guard<mutex> guard(lock);
+    rethrowFailure();
+}
+
+// hands the error over once and lets the merger try again
+void LSMIndex::rethrowFailure() const{
+    if(!failure) return;
+    exception_ptr error = failure;
+    failure = nullptr;
+    wake.notify_one();
+    rethrow_exception(error);
+}
+
+int LSMIndex::indexCount() const{
+    return (int)atomic_load(&live)->size();
+}
+
+
+// ---------------------- Search ----------------------
+void LSMIndex::search(const Point &q, ResultSet &result) const{
+    shared_ptr<const Runs> runs = atomic_load(&live);
+    for(const Run &run : *runs){
+        run.index->search(q, result);
+    }
+}
+
+void LSMIndex::collect(vector<Point> &out) const{
+    shared_ptr<const Runs> runs = atomic_load(&live);
+    for(const Run &run : *runs){
+        run.index->collect(out);
+    }
+}
+
+// ---------------------- Build Report ----------------------
+void LSMIndex::report(BuildReport &report) const{
+    shared_ptr<const Runs> runs = atomic_load(&live);
+    for(const Run &run : *runs){
+        run.index->report(report);
+    }
+}
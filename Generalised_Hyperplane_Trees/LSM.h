@@ -0,0 +1,79 @@
+#pragma once
+#include "metric_index.h"
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+
+
+// ---------------------- Log-Structured Index ----------------------
+// a set of indices of one kind that grows by batches: every inserted batch is built into a small index of its
+// own at level 0, and a background thread merges two indices of the same level into one a level up, so a point
+// takes part in O(log n) merges and an insert only pays for building its batch
+// queries fan out over the live indices with one shared bound; merges replace their inputs in one step, so a
+// query sees every point exactly once whatever the merger is doing; stats are kept by the merger as well, read
+// them after wait()
+// a merge that throws (over memoryBudget, out of memory) leaves its pair live and searchable and stops merging;
+// the error is rethrown by the next insert or wait, after which merging resumes
+class LSMIndex : public MetricIndex{
+public:
+    // prototype is emptied and cloned for every new index (owned by the LSM index), so its kind and settings are
+    // used throughout
+    explicit LSMIndex(MetricIndex* prototype);
+    LSMIndex(const LSMIndex &other); // waits for other's merges, then clones its live indices
+    LSMIndex& operator=(const LSMIndex&) = delete;
+    ~LSMIndex();
+
+    const char* name() const override{
+        return "LSM";
+    }
+
+    // drops every index, then inserts arr[0..n) as one batch and waits for it to be merged in
+    void build(const Point arr[], int n) override;
+
+    // builds arr[0..n) into a level 0 index and makes it live, merging is left to the background thread
+    // first rethrows what a merge threw since the last insert or wait, without inserting
+    void insert(const Point arr[], int n);
+
+    // blocks until no merge is running or waiting, then rethrows what a merge threw since the last insert or wait
+    void wait() const;
+
+    // no of live indices
+    int indexCount() const;
+
+    void search(const Point &q, ResultSet &result) const override;
+    void report(BuildReport &report) const override;
+    void collect(std::vector<Point> &out) const override;
+    void merge(const MetricIndex &other) override; // inserts other's points as one batch
+
+    MetricIndex* clone() const override{
+        return new LSMIndex(*this);
+    }
+
+private:
+    struct Run{
+        std::shared_ptr<MetricIndex> index;
+        int level;
+    };
+    typedef std::vector<Run> Runs;
+
+    std::unique_ptr<MetricIndex> prototype;
+    std::shared_ptr<const Runs> live; // replaced as a whole, read with std::atomic_load
+
+    // guards replacing live, stats and the merger state
+    mutable std::mutex lock;
+    mutable std::condition_variable wake; // a merge may have become possible, or stopping is set
+    mutable std::condition_variable idle; // the merger found nothing to do
+    bool merging = false;
+    bool stopping = false;
+    mutable std::exception_ptr failure; // of the last merge, set by the merger and taken by insert or wait
+    std::thread merger;
+
+    void start();
+    void waitIdle() const;
+    void rethrowFailure() const; // with lock held
+    void mergeLoop();
+    bool pickMerge(const Runs &runs, int &a, int &b) const;
+    void publish(const std::shared_ptr<const Runs> &runs);
+};
@@ -0,0 +1,147 @@
+#include "PivotFilter.h"
+#include <algorithm>
+using namespace std;
+
+
+// ---------------------- Build ----------------------
+// the distances from every point to a pivot fill one column of the table; farthest-first selection needs exactly
+// those distances to pick the next pivot, so either policy costs n distance computations per pivot
+void PivotFilter::build(const Point arr[], int n){
+    stats = IndexStats();
+    points.assign(arr, arr+n);
+    pivots.clear();
+    int m = min(pivotCount, n);
+    table.assign((size_t)n*m, 0);
+
+    SplitRng rng(seed);
+    vector<int> order(n);
+    for(int i=0; i<n; i++) order[i] = i;
+    vector<float> nearestPivot(n, numeric_limits<float>::infinity());
+    for(int j=0; j<m; j++){
+        int p;
+        if(pivotPolicy==0 || j==0){
+            swap(order[j], order[j+rng.below(n-j)]);
+            p = order[j];
+        }
+        else{
+            p = (int)(max_element(nearestPivot.begin(), nearestPivot.end())-nearestPivot.begin());
+            if(nearestPivot[p]<=0) break; // every point coincides with a pivot, another would repeat one and add nothing
+        }
+        pivots.push_back(p);
+        for(int i=0; i<n; i++){
+            float d = distance(points[i], points[p]);
+            stats.computationsBuild++;
+            table[(size_t)j*n+i] = d;
+            nearestPivot[i] = min(nearestPivot[i], d);
+        }
+    }
+    m = (int)pivots.size();
+    table.resize((size_t)n*m);
+    stats.pivotCount = m;
+    stats.pointCount = n;
+}
+
+void PivotFilter::collect(vector<Point> &out) const{
+    out.insert(out.end(), points.begin(), points.end());
+}
+
+
+// ---------------------- Search ----------------------
+// raises every bound to what one pivot proves, a loop over contiguous floats the compiler vectorizes across points
+static void boundPass(float e, const float* __restrict column, float* __restrict bounds, int n){
+    for(int i=0; i<n; i++){
+        bounds[i] = max(bounds[i], fabsf(e-column[i]));
+    }
+}
+
+// the largest bound a point can have and still be checked, the slack covers the rounding of the pivot distances
+static inline float admit(float bound){
+    return bound*(1+1e-4f)/(1-1e-4f);
+}
+
+// per-thread scratch of search, kept between queries so a query only calls the allocator when the index grew
+struct FilterScratch{
+    vector<float> embedded;
+    vector<float> bounds;
+    vector<pair<float, int>> seeds;
+};
+static thread_local FilterScratch scratch;
+
+void PivotFilter::search(const Point &q, ResultSet &result) const{
+    int n = (int)points.size();
+    int m = (int)pivots.size();
+    vector<float> &embedded = scratch.embedded;
+    embedded.resize(m);
+    for(int j=0; j<m && !result.exhausted(); j++){
+        embedded[j] = distance(q, points[pivots[j]]);
+        result.computations++;
+        result.offer(points[pivots[j]], embedded[j]);
+    }
+    if(result.exhausted()){
+        result.leaveOut(0); // out before the bounds, nothing is known of the points
+        return;
+    }
+
+    // the L_inf distance of every embedding to that of q, one pivot at a time; bounds[i] = -1 marks a point
+    // already offered
+    vector<float> &bounds = scratch.bounds;
+    bounds.assign(n, 0);
+    for(int j=0; j<m; j++){
+        boundPass(embedded[j], &table[(size_t)j*n], bounds.data(), n);
+    }
+    for(int p : pivots){
+        bounds[p] = -1;
+    }
+
+    // the seedCount smallest bounds are checked first and in order; the radius they leave filters the rest in one
+    // pass, sorting all n bounds would cost more than it saves
+    vector<pair<float, int>> &seeds = scratch.seeds;
+    seeds.clear();
+    for(int i=0; i<n; i++){
+        if(bounds[i]<0) continue;
+        if((int)seeds.size()<seedCount){
+            seeds.push_back({bounds[i], i});
+            push_heap(seeds.begin(), seeds.end());
+        }
+        else if(!seeds.empty() && bounds[i]<seeds.front().first){
+            pop_heap(seeds.begin(), seeds.end());
+            seeds.back() = {bounds[i], i};
+            push_heap(seeds.begin(), seeds.end());
+        }
+    }
+    sort_heap(seeds.begin(), seeds.end());
+
+    for(const pair<float, int> &seed : seeds){
+        if(seed.first>admit(result.bound())) break;
+        if(result.exhausted()){
+            result.leaveOut(0); // the bounds are of the embedding, not to be trusted below the slack
+            return;
+        }
+        float d = distance(q, points[seed.second]);
+        result.computations++;
+        result.offer(points[seed.second], d);
+        bounds[seed.second] = -1;
+    }
+    float limit = admit(result.bound());
+    for(int i=0; i<n; i++){
+        if(bounds[i]<0 || bounds[i]>limit) continue;
+        if(result.exhausted()){
+            result.leaveOut(0);
+            break;
+        }
+        float d = distance(q, points[i]);
+        result.computations++;
+        result.offer(points[i], d);
+        limit = admit(result.bound());
+    }
+}
+
+
+// ---------------------- Build Report ----------------------
+// the pivots form one root over a single leaf holding the points and their embeddings
+void PivotFilter::report(BuildReport &report) const{
+    int n = (int)points.size();
+    if(n==0) return;
+    report.addLeaf(1, min(n, N_MAX), (long long)n*(sizeof(Point)+pivots.size()*sizeof(float)));
+    report.addSplit(0, 1, (int)pivots.size(), 0, sizeof(PivotFilter)+pivots.size()*sizeof(int));
+}
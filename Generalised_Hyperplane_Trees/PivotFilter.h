@@ -0,0 +1,40 @@
+#pragma once
+#include "metric_index.h"
+
+
+// ---------------------- Pivot Filter ----------------------
+// every point is embedded as its vector of distances to pivotCount global pivots. By the triangle inequality
+// |d(q,p)-d(x,p)| <= d(q,x) for every pivot p, so the L_inf distance between the embeddings of q and x is a lower
+// bound on d(q,x) under any of the metrics. Search embeds q with pivotCount distance computations, bounds every
+// point with that cheap pivotCount-dimensional distance, and computes distance() only for the points whose bound
+// does not exceed the current radius, the smallest bounds first so the radius shrinks early
+// the table is stored pivot by pivot, so bounding every point is one vectorizable pass over contiguous floats per pivot
+class PivotFilter : public MetricIndex{
+public:
+    int pivotCount = 16; // dimensions of the embedding, capped at the number of distinct points
+    // 0 - random pivots
+    // 1 - farthest-first pivots, each the point farthest from those chosen so far
+    int pivotPolicy = 1;
+    int seedCount = 8; // points with the smallest bounds, computed first so the radius is tight for the rest
+
+    std::vector<Point> points;
+    std::vector<int> pivots; // positions in points
+
+    PivotFilter(int metricType=1, int pivotCount=16) : MetricIndex(metricType, 0), pivotCount(pivotCount) {}
+
+    const char* name() const override{
+        return "Pivot Filter";
+    }
+
+    void build(const Point arr[], int n) override;
+    void search(const Point &q, ResultSet &result) const override;
+    void report(BuildReport &report) const override;
+    void collect(std::vector<Point> &out) const override;
+
+    MetricIndex* clone() const override{
+        return new PivotFilter(*this);
+    }
+
+private:
+    std::vector<float> table; // d(point i, pivot j) is table[j*n+i]
+};
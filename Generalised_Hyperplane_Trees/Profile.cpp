@@ -0,0 +1,80 @@
+#include "Profile.h"
+#include <algorithm>
+#include <random>
+using namespace std;
+
+#define PROFILE_QUERIES 32 // sampled nearest neighbour searches
+
+
+DistanceProfile profileDistances(const Point arr[], int n, int metricType, long long samplePairs, long long sampleTriples, unsigned seed){
+    DistanceProfile profile;
+    profile.metricType = metricType;
+    if(n<2) return profile;
+    mt19937 rng(seed);
+
+    // moments and range of the pairwise distances
+    vector<float> sampled;
+    sampled.reserve(samplePairs);
+    double sum = 0, sumSquares = 0;
+    profile.minDist = numeric_limits<double>::infinity();
+    for(long long s=0; s<samplePairs; s++){
+        int i = rng()%n, j = rng()%(n-1);
+        if(j>=i) j++; // distinct points
+        float d = distance(arr[i], arr[j], metricType);
+        sampled.push_back(d);
+        sum += d;
+        sumSquares += (double)d*d;
+        profile.minDist = min(profile.minDist, (double)d);
+        profile.maxDist = max(profile.maxDist, (double)d);
+    }
+    profile.pairs = samplePairs;
+    profile.mean = sum/samplePairs;
+    double variance = max(0.0, sumSquares/samplePairs-profile.mean*profile.mean);
+    profile.deviation = sqrt(variance);
+    profile.intrinsicDim = (variance>0) ? profile.mean*profile.mean/(2*variance) : numeric_limits<double>::infinity();
+    for(float d : sampled){
+        int bin = (profile.maxDist>0) ? (int)(d/profile.maxDist*PROFILE_BINS) : 0;
+        profile.histogram[min(bin, PROFILE_BINS-1)]++;
+    }
+
+    // the radius a nearest neighbour search ends with: queries are data points, their own distance 0 left out
+    vector<float> nearest;
+    for(int s=0; s<PROFILE_QUERIES; s++){
+        int q = rng()%n;
+        float best = numeric_limits<float>::infinity();
+        for(int i=0; i<n; i++){
+            if(i!=q) best = min(best, distance(arr[q], arr[i], metricType));
+        }
+        nearest.push_back(best);
+    }
+    nth_element(nearest.begin(), nearest.begin()+PROFILE_QUERIES/2, nearest.end());
+    profile.nearestDist = nearest[PROFILE_QUERIES/2];
+
+    long long excluded = 0;
+    for(long long s=0; s<sampleTriples; s++){
+        const Point &q = arr[rng()%n], &p = arr[rng()%n], &x = arr[rng()%n];
+        if(fabsf(distance(q, p, metricType)-distance(x, p, metricType))>profile.nearestDist) excluded++;
+    }
+    profile.pruning = (sampleTriples>0) ? (double)excluded/sampleTriples : 0;
+
+    // a tree pays for its pivots and visits, so it only beats a scan when pivots exclude most points
+    if(profile.pruning>=0.5) profile.recommendation = 0;
+    else if(profile.pruning>=0.1) profile.recommendation = 1;
+    else profile.recommendation = 2;
+    return profile;
+}
+
+void printProfile(const DistanceProfile &profile){
+    const char* metricNames[] = {"L2", "L1", "L_inf"};
+    const char* advice[] = {"a tree index", "the approximate forest, exact trees would be close to a scan", "a plain scan"};
+    cout<<fixed<<setprecision(2);
+    cout<<metricNames[profile.metricType]<<": "<<profile.pairs<<" pairs, distance "<<profile.mean<<" +- "<<profile.deviation
+        <<" (range "<<profile.minDist<<" - "<<profile.maxDist<<"), intrinsic dimensionality "<<profile.intrinsicDim<<endl;
+    cout<<"  Histogram:";
+    for(int b=0; b<PROFILE_BINS; b++){
+        cout<<" "<<profile.histogram[b];
+    }
+    cout<<endl;
+    cout<<"  Median nearest neighbour distance "<<profile.nearestDist<<", one pivot excludes "<<(100*profile.pruning)<<"% of the points"<<endl;
+    cout<<"  Recommended: "<<advice[profile.recommendation]<<endl;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "metric_index.h"
+
+#define PROFILE_BINS 20 // histogram bins between 0 and the largest sampled distance
+
+
+// ---------------------- Distance Profile ----------------------
+// how the distances of a dataset are distributed under one metric, which decides whether pivots can prune at all:
+// when every distance is close to the mean, |d(q,p)-d(x,p)| is rarely larger than the query radius
+struct DistanceProfile{
+    int metricType = 0;
+    long long pairs = 0; // random pairs of points sampled
+    double mean = 0, deviation = 0, minDist = 0, maxDist = 0;
+    double intrinsicDim = 0; // rho = mean^2/(2 variance), large when distances concentrate
+    long long histogram[PROFILE_BINS] = {};
+    double nearestDist = 0; // median distance from a sampled query to its nearest neighbour among all points
+    // the chance that one random pivot excludes a random point from a nearest neighbour search,
+    // i.e. |d(q,p)-d(x,p)| > nearestDist over sampled triples; about the share of distances a tree saves
+    double pruning = 0;
+    // 0 - a tree index
+    // 1 - the approximate forest (or a budgeted search), exact trees would be close to a scan
+    // 2 - a plain scan
+    int recommendation = 0;
+};
+
+// samples pairs and triples of arr[0..n) and a few nearest neighbour searches over it, about
+// samplePairs + 2*sampleTriples + 32*n distance computations
+DistanceProfile profileDistances(const Point arr[], int n, int metricType, long long samplePairs=20000, long long sampleTriples=20000, unsigned seed=1);
+
+void printProfile(const DistanceProfile &profile);
@@ -0,0 +1,132 @@
+#include "Scan.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+using namespace std;
+
+
+// ---------------------- Build ----------------------
+void LinearScan::build(const Point arr[], int n){
+    stats = IndexStats();
+    points.assign(arr, arr+n);
+    rows.assign((size_t)n*SCAN_STRIDE, 0);
+    for(int i=0; i<n; i++){
+        copy(arr[i].coords, arr[i].coords+D, rows.begin()+(size_t)i*SCAN_STRIDE);
+    }
+    stats.pointCount = n;
+}
+
+void LinearScan::collect(vector<Point> &out) const{
+    out.insert(out.end(), points.begin(), points.end());
+}
+
+
+// ---------------------- Kernels ----------------------
+// distance between two padded rows; the lane sums are combined at the end, so the result can differ from
+// distance() in the last bits for L1 and L2
+static inline float scanDistance(const float* __restrict q, const float* __restrict x, int metricType){
+    float acc[SCAN_LANES] = {};
+    if(metricType==0){
+        for(int j=0; j<SCAN_STRIDE; j+=SCAN_LANES){
+            for(int l=0; l<SCAN_LANES; l++){
+                float diff = q[j+l]-x[j+l];
+                acc[l] += diff*diff;
+            }
+        }
+    }
+    else if(metricType==1){
+        for(int j=0; j<SCAN_STRIDE; j+=SCAN_LANES){
+            for(int l=0; l<SCAN_LANES; l++){
+                acc[l] += fabsf(q[j+l]-x[j+l]);
+            }
+        }
+    }
+    else{
+        for(int j=0; j<SCAN_STRIDE; j+=SCAN_LANES){
+            for(int l=0; l<SCAN_LANES; l++){
+                acc[l] = max(acc[l], fabsf(q[j+l]-x[j+l]));
+            }
+        }
+    }
+    float d = acc[0];
+    for(int l=1; l<SCAN_LANES; l++){
+        d = (metricType==2) ? max(d, acc[l]) : d+acc[l];
+    }
+    return (metricType==0) ? sqrtf(d) : d;
+}
+
+// offers points[first..last) to result; q is the padded query
+// the slack covers the rounding difference between the kernel and distance()
+void LinearScan::scanBlock(const float q[], const Point &query, int first, int last, ResultSet &result) const{
+    for(int i=first; i<last; i++){
+        if(result.exhausted()){
+            result.leaveOut(0); // nothing is known of the points not scanned
+            return;
+        }
+        float d = scanDistance(q, &rows[(size_t)i*SCAN_STRIDE], metricType);
+        result.computations++;
+        float bound = result.bound();
+        if(d<=bound+1e-4f*(bound+d)) result.offer(points[i], distance(query, points[i]));
+    }
+}
+
+static void padQuery(const Point &q, float out[]){
+    for(int j=0; j<SCAN_STRIDE; j++){
+        out[j] = (j<D) ? q.coords[j] : 0;
+    }
+}
+
+
+// ---------------------- Search ----------------------
+void LinearScan::search(const Point &q, ResultSet &result) const{
+    alignas(32) float padded[SCAN_STRIDE];
+    padQuery(q, padded);
+    scanBlock(padded, q, 0, (int)points.size(), result);
+}
+
+void LinearScan::searchBatch(const Point queries[], ResultSet results[], int count) const{
+    int n = (int)points.size();
+    int blocks = (count+queryBlock-1)/queryBlock;
+    int workers = (threads>0) ? threads : max(1, (int)thread::hardware_concurrency());
+    workers = max(1, min(workers, blocks));
+
+    atomic<int> next(0);
+    auto work = [&](){
+        vector<float> padded((size_t)queryBlock*SCAN_STRIDE);
+        for(int b=next++; b<blocks; b=next++){
+            int first = b*queryBlock, last = min(count, first+queryBlock);
+            for(int i=first; i<last; i++){
+                padQuery(queries[i], &padded[(size_t)(i-first)*SCAN_STRIDE]);
+            }
+            for(int p=0; p<n; p+=pointBlock){
+                for(int i=first; i<last; i++){
+                    scanBlock(&padded[(size_t)(i-first)*SCAN_STRIDE], queries[i], p, min(n, p+pointBlock), results[i]);
+                }
+            }
+        }
+    };
+    if(workers==1){
+        work();
+        return;
+    }
+    vector<thread> pool;
+    for(int t=0; t<workers; t++){
+        pool.emplace_back(work);
+    }
+    for(thread &t : pool){
+        t.join();
+    }
+}
+
+
+// ---------------------- Build Report ----------------------
+// every block of pointBlock points counts as a leaf under one root
+void LinearScan::report(BuildReport &report) const{
+    int n = (int)points.size();
+    int blocks = 0;
+    for(int p=0; p<n; p+=pointBlock, blocks++){
+        int count = min(pointBlock, n-p);
+        report.addLeaf(1, min(count, N_MAX), (long long)count*(sizeof(Point)+SCAN_STRIDE*sizeof(float)));
+    }
+    report.addSplit(0, blocks, 0, 0, sizeof(LinearScan));
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "metric_index.h"
+
+#define SCAN_LANES 8 // independent accumulators per distance, the width the kernels are written for
+#define SCAN_STRIDE ((D+SCAN_LANES-1)/SCAN_LANES*SCAN_LANES) // floats per stored point, zero padded
+
+
+// ---------------------- Linear Scan ----------------------
+// exact search by computing the distance to every point, the baseline the trees are measured against and the
+// fallback when they cannot prune
+// points are kept as zero padded rows of floats; the kernels split every distance over SCAN_LANES accumulators,
+// which the compiler maps onto SIMD registers. A distance that could enter the result is computed again with
+// distance(), so the answers are exactly those of the trees
+class LinearScan : public MetricIndex{
+public:
+    int threads = 0; // searchBatch threads, 0 - one per hardware thread
+    int queryBlock = 8; // queries scored together against each block of points
+    int pointBlock = 256; // points per block, 256 rows of D=50 are ~56 KB and stay in L2 over a query block
+
+    std::vector<Point> points;
+
+    LinearScan(int metricType=1) : MetricIndex(metricType, 0) {}
+
+    const char* name() const override{
+        return "Linear Scan";
+    }
+
+    void build(const Point arr[], int n) override;
+    void search(const Point &q, ResultSet &result) const override;
+    void report(BuildReport &report) const override;
+    void collect(std::vector<Point> &out) const override;
+
+    MetricIndex* clone() const override{
+        return new LinearScan(*this);
+    }
+
+    // answers queries[0..count) into results[0..count), same answers as search()
+    // blocks of queryBlock queries are spread over the threads, each block goes through the points pointBlock at a time
+    void searchBatch(const Point queries[], ResultSet results[], int count) const;
+
+private:
+    std::vector<float> rows; // point i is rows[i*SCAN_STRIDE..(i+1)*SCAN_STRIDE)
+
+    void scanBlock(const float q[], const Point &query, int first, int last, ResultSet &result) const;
+};
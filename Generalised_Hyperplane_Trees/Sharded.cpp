@@ -0,0 +1,425 @@
+#include "Sharded.h"
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+using namespace std;
+
+
+// ---------------------- Protocol ----------------------
+// every request starts with a ShardRequest; the worker answers a search with a ShardAnswer and the neighbours found,
+// an insert (followed by count points) with a ShardStatus, a collect with a count and the points, a report with a
+// BuildReport; build is answered by a ShardStatus once the shard is built
+enum ShardOp{SHARD_SEARCH, SHARD_INSERT, SHARD_COLLECT, SHARD_REPORT, SHARD_STOP};
+
+struct ShardRequest{
+    int op;
+    int k;
+    int count; // points following an insert
+    float radius;
+    long long budget; // computations left to the query, -1 for no limit
+    long long deadline; // steady_clock ticks since its epoch, the same clock in every process; -1 for none
+    Point q;
+};
+
+struct ShardAnswer{
+    int count; // neighbours following
+    float unexplored;
+    long long computations;
+};
+
+struct ShardStatus{
+    int failure; // 0 - none, 1 - over memoryBudget, 2 - any other error
+    IndexStats stats;
+};
+
+// a closed socket means the other side is gone, SIGPIPE is kept from killing the router in that case
+static void sendAll(int fd, const void* data, size_t bytes){
+    const char* p = (const char*)data;
+    while(bytes>0){
+        ssize_t sent = send(fd, p, bytes, MSG_NOSIGNAL);
+        if(sent<0 && errno==EINTR) continue;
+        if(sent<=0) throw runtime_error("ShardedIndex: a worker is gone");
+        p += sent;
+        bytes -= sent;
+    }
+}
+
+static void receiveAll(int fd, void* data, size_t bytes){
+    char* p = (char*)data;
+    while(bytes>0){
+        ssize_t got = recv(fd, p, bytes, 0);
+        if(got<0 && errno==EINTR) continue;
+        if(got<=0) throw runtime_error("ShardedIndex: a worker is gone");
+        p += got;
+        bytes -= got;
+    }
+}
+
+
+ShardedIndex::ShardedIndex(MetricIndex* prototype, int shardCount) : MetricIndex(prototype->metricType, prototype->leafSize), shardCount(shardCount), prototype(prototype){
+    prototype->build(nullptr, 0); // only its settings are needed
+}
+
+ShardedIndex::~ShardedIndex(){
+    stopWorkers();
+}
+
+void ShardedIndex::stopWorkers(){
+    for(unique_ptr<Shard> &shard : shards){
+        if(shard->pid<0) continue; // build failed before starting it
+        ShardRequest request = {};
+        request.op = SHARD_STOP;
+        try{
+            sendAll(shard->fd, &request, sizeof(request));
+        }
+        catch(...){} // already gone
+        close(shard->fd);
+        waitpid(shard->pid, nullptr, 0);
+    }
+    shards.clear();
+}
+
+
+// ---------------------- Build ----------------------
+// the shard a point belongs to; dist is its distance to the shard's pivot under pivot partitioning
+int ShardedIndex::shardOf(const Point &p, float &dist) const{
+    int s = (int)shards.size();
+    dist = 0;
+    if(partitionPolicy==0) return (int)(SplitRng((unsigned)p.id)()%(unsigned long long)s);
+    int nearest = 0;
+    for(int j=0; j<s; j++){
+        float d = distance(p, shards[j]->pivot);
+        if(j==0 || d<dist){
+            dist = d;
+            nearest = j;
+        }
+    }
+    return nearest;
+}
+
+void ShardedIndex::build(const Point arr[], int n){
+    stopWorkers();
+    stats = IndexStats();
+    partitionComputations = 0;
+    int s = max(1, shardCount);
+    if(partitionPolicy==1) s = max(1, min(s, n));
+    for(int j=0; j<s; j++) shards.push_back(unique_ptr<Shard>(new Shard()));
+
+    if(partitionPolicy==1 && n>0){
+        // distinct pivots, a partial Fisher-Yates shuffle of the positions
+        SplitRng rng(seed);
+        vector<int> order(n);
+        for(int i=0; i<n; i++) order[i] = i;
+        for(int j=0; j<s; j++){
+            swap(order[j], order[j+rng.below(n-j)]);
+            shards[j]->pivot = arr[order[j]];
+        }
+    }
+    vector<vector<Point>> parts(s);
+    for(int i=0; i<n; i++){
+        float dist;
+        int j = shardOf(arr[i], dist);
+        if(partitionPolicy==1) partitionComputations += s;
+        parts[j].push_back(arr[i]);
+        shards[j]->radius = max(shards[j]->radius, dist);
+    }
+
+    // every worker builds its shard while the others do, the router then waits for all of them
+    for(int j=0; j<s; j++){
+        int ends[2];
+        if(socketpair(AF_UNIX, SOCK_STREAM, 0, ends)!=0) throw runtime_error("ShardedIndex::build: cannot create a socket");
+        pid_t pid = fork();
+        if(pid<0) throw runtime_error("ShardedIndex::build: cannot start a worker");
+        if(pid==0){
+            close(ends[0]);
+            for(int other=0; other<j; other++) close(shards[other]->fd);
+            serve(ends[1], parts[j]);
+            _exit(0);
+        }
+        close(ends[1]);
+        shards[j]->pid = pid;
+        shards[j]->fd = ends[0];
+        shards[j]->count = (int)parts[j].size();
+        vector<Point>().swap(parts[j]);
+    }
+
+    vector<ShardStatus> status(s);
+    int failure = 0;
+    for(int j=0; j<s; j++){
+        receiveAll(shards[j]->fd, &status[j], sizeof(ShardStatus));
+        failure = max(failure, status[j].failure);
+    }
+    if(failure){ // no shard is kept, so the index is left empty
+        stopWorkers();
+        if(failure==1) throw length_error("ShardedIndex::build: a shard is over memory budget");
+        throw runtime_error("ShardedIndex::build: a worker failed to build its shard");
+    }
+    vector<IndexStats> shardStats(s);
+    for(int j=0; j<s; j++) shardStats[j] = status[j].stats;
+    refreshStats(shardStats.data());
+}
+
+// the sums over the shards; a worker's build peak is its own, the largest of them is the most any process needed
+void ShardedIndex::refreshStats(const IndexStats shardStats[]){
+    long long computationsBuild = partitionComputations;
+    stats.pointCount = 0;
+    stats.pivotCount = 0;
+    stats.resampleCount = 0;
+    stats.memoryBytes = (long long)shards.size()*sizeof(Shard);
+    stats.peakBuildBytes = 0;
+    for(int j=0; j<(int)shards.size(); j++){
+        computationsBuild += shardStats[j].computationsBuild;
+        stats.pointCount += shardStats[j].pointCount;
+        stats.pivotCount += shardStats[j].pivotCount;
+        stats.resampleCount += shardStats[j].resampleCount;
+        stats.memoryBytes += shardStats[j].memoryBytes;
+        stats.peakBuildBytes = max(stats.peakBuildBytes, shardStats[j].peakBuildBytes);
+    }
+    stats.computationsBuild = computationsBuild;
+}
+
+
+// ---------------------- Worker ----------------------
+// runs in the forked worker: builds the shard, then answers requests until told to stop or the router is gone
+void ShardedIndex::serve(int fd, const vector<Point> &part){
+    unique_ptr<MetricIndex> index(prototype->clone());
+    index->seed = seed;
+    if(memoryBudget>=0) index->memoryBudget = memoryBudget;
+    ShardStatus status = {};
+    try{
+        index->build(part.data(), (int)part.size());
+    }
+    catch(const length_error&){
+        status.failure = 1;
+    }
+    catch(...){
+        status.failure = 2;
+    }
+    status.stats = index->stats;
+
+    try{
+        sendAll(fd, &status, sizeof(status));
+        if(status.failure) return;
+        ShardRequest request;
+        ResultSet result;
+        vector<Point> points;
+        while(true){
+            receiveAll(fd, &request, sizeof(request));
+            if(request.op==SHARD_STOP) return;
+
+            if(request.op==SHARD_SEARCH){
+                result.reset(request.k, request.radius, request.budget);
+                if(request.deadline>=0) result.expireAt(chrono::steady_clock::time_point(chrono::steady_clock::duration(request.deadline)));
+                index->search(request.q, result);
+                vector<Neighbor> found = result.sorted();
+                ShardAnswer answer = {(int)found.size(), result.unexplored, result.computations};
+                sendAll(fd, &answer, sizeof(answer));
+                sendAll(fd, found.data(), found.size()*sizeof(Neighbor));
+            }
+            else if(request.op==SHARD_INSERT){
+                points.resize(request.count);
+                receiveAll(fd, points.data(), points.size()*sizeof(Point));
+                status.failure = 0;
+                try{
+                    unique_ptr<MetricIndex> incoming(prototype->clone());
+                    incoming->build(points.data(), request.count);
+                    index->merge(*incoming);
+                }
+                catch(const length_error&){
+                    status.failure = 1;
+                }
+                catch(...){
+                    status.failure = 2;
+                }
+                status.stats = index->stats;
+                sendAll(fd, &status, sizeof(status));
+            }
+            else if(request.op==SHARD_COLLECT){
+                points.clear();
+                index->collect(points);
+                int count = (int)points.size();
+                sendAll(fd, &count, sizeof(count));
+                sendAll(fd, points.data(), points.size()*sizeof(Point));
+            }
+            else if(request.op==SHARD_REPORT){
+                BuildReport report;
+                index->report(report);
+                sendAll(fd, &report, sizeof(report));
+            }
+        }
+    }
+    catch(...){} // the router is gone
+}
+
+
+// ---------------------- Search ----------------------
+// per-thread scratch of search, so a query does not call the allocator
+struct RouterScratch{
+    vector<pair<float, int>> order; // lower bound of each shard, and the shard
+    vector<Neighbor> found;
+};
+static thread_local RouterScratch scratch;
+
+// under pivot partitioning nothing in shard j is nearer to q than d(q,p_j) minus its covering radius, nor than
+// (d(q,p_j)-d(q,p_nearest))/2, its points being nearer to p_j than to any other pivot
+void ShardedIndex::search(const Point &q, ResultSet &result) const{
+    int s = (int)shards.size();
+    vector<pair<float, int>> &order = scratch.order;
+    order.resize(s);
+    if(partitionPolicy==1){
+        float nearest = numeric_limits<float>::infinity();
+        for(int j=0; j<s; j++){
+            order[j] = {distance(q, shards[j]->pivot), j};
+            nearest = min(nearest, order[j].first);
+        }
+        result.computations += s;
+        for(int j=0; j<s; j++){
+            float d = order[j].first;
+            order[j].first = max(0.0f, max(d-shards[j]->radius, (d-nearest)/2));
+        }
+        sort(order.begin(), order.end());
+    }
+    else{
+        for(int j=0; j<s; j++) order[j] = {0, j};
+    }
+
+    vector<Neighbor> &found = scratch.found;
+    for(const pair<float, int> &next : order){
+        Shard &shard = *shards[next.second];
+        if(shard.count==0 || next.first > result.bound()) continue;
+        if(result.exhausted()){
+            result.leaveOut(next.first);
+            continue;
+        }
+
+        ShardRequest request = {};
+        request.op = SHARD_SEARCH;
+        request.k = result.wanted();
+        request.radius = result.bound();
+        request.budget = (result.budget>=0) ? result.budget-result.computations : -1;
+        request.deadline = result.hasDeadline() ? result.expiry().time_since_epoch().count() : -1;
+        request.q = q;
+        ShardAnswer answer;
+        {
+            lock_guard<mutex> guard(shard.lock);
+            sendAll(shard.fd, &request, sizeof(request));
+            receiveAll(shard.fd, &answer, sizeof(answer));
+            found.resize(answer.count);
+            receiveAll(shard.fd, found.data(), found.size()*sizeof(Neighbor));
+        }
+        shardRequests++;
+        result.computations += answer.computations;
+        result.leaveOut(answer.unexplored);
+        for(const Neighbor &neighbor : found) result.offer(neighbor.point, neighbor.dist);
+    }
+}
+
+void ShardedIndex::collect(vector<Point> &out) const{
+    for(const unique_ptr<Shard> &shard : shards){
+        ShardRequest request = {};
+        request.op = SHARD_COLLECT;
+        lock_guard<mutex> guard(shard->lock);
+        sendAll(shard->fd, &request, sizeof(request));
+        int count;
+        receiveAll(shard->fd, &count, sizeof(count));
+        size_t first = out.size();
+        out.resize(first+count);
+        receiveAll(shard->fd, out.data()+first, (size_t)count*sizeof(Point));
+    }
+}
+
+MetricIndex* ShardedIndex::clone() const{
+    ShardedIndex* copy = new ShardedIndex(prototype->clone(), shardCount);
+    copy->partitionPolicy = partitionPolicy;
+    copy->seed = seed;
+    copy->memoryBudget = memoryBudget;
+    vector<Point> points;
+    collect(points);
+    copy->build(points.data(), (int)points.size());
+    copy->stats = stats;
+    return copy;
+}
+
+
+// ---------------------- Merge ----------------------
+// a shard whose worker fails to merge keeps what it held, the others keep what they merged; the error is thrown
+// once every shard has answered
+void ShardedIndex::merge(const MetricIndex &other){
+    if(shards.empty()){
+        MetricIndex::merge(other);
+        return;
+    }
+    vector<Point> incoming;
+    other.collect(incoming);
+    int s = (int)shards.size();
+    vector<vector<Point>> parts(s);
+    for(const Point &p : incoming){
+        float dist;
+        int j = shardOf(p, dist);
+        if(partitionPolicy==1) partitionComputations += s;
+        parts[j].push_back(p);
+        shards[j]->radius = max(shards[j]->radius, dist);
+    }
+
+    vector<IndexStats> shardStats(s);
+    int failure = 0;
+    for(int j=0; j<s; j++){
+        ShardRequest request = {};
+        request.op = SHARD_INSERT;
+        request.count = (int)parts[j].size();
+        ShardStatus status;
+        lock_guard<mutex> guard(shards[j]->lock);
+        sendAll(shards[j]->fd, &request, sizeof(request));
+        sendAll(shards[j]->fd, parts[j].data(), parts[j].size()*sizeof(Point));
+        receiveAll(shards[j]->fd, &status, sizeof(status));
+        shardStats[j] = status.stats;
+        shards[j]->count = status.stats.pointCount;
+        failure = max(failure, status.failure);
+    }
+    refreshStats(shardStats.data());
+    if(failure==1) throw length_error("ShardedIndex::merge: a shard is over memory budget");
+    if(failure) throw runtime_error("ShardedIndex::merge: a worker failed to merge into its shard");
+}
+
+
+// ---------------------- Build Report ----------------------
+// the router is the root, splitting into the shards; each shard's report is added one level below it
+void ShardedIndex::report(BuildReport &report) const{
+    if(shards.empty()) return;
+    int smallest = N_MAX, largest = 0, total = 0;
+    for(const unique_ptr<Shard> &shard : shards){
+        smallest = min(smallest, shard->count);
+        largest = max(largest, shard->count);
+        total += shard->count;
+    }
+    float imbalance = (total==0) ? 0 : (float)(largest-smallest)/total;
+    report.addSplit(0, (int)shards.size(), 0, imbalance, (long long)shards.size()*sizeof(Shard));
+
+    for(const unique_ptr<Shard> &shard : shards){
+        ShardRequest request = {};
+        request.op = SHARD_REPORT;
+        BuildReport part;
+        {
+            lock_guard<mutex> guard(shard->lock);
+            sendAll(shard->fd, &request, sizeof(request));
+            receiveAll(shard->fd, &part, sizeof(part));
+        }
+        report.nodes += part.nodes;
+        report.leaves += part.leaves;
+        report.pivots += part.pivots;
+        report.memoryBytes += part.memoryBytes;
+        if(part.nodes>0) report.maxDepth = max(report.maxDepth, part.maxDepth+1);
+        for(int d=0; d<MAX_DEPTH; d++){
+            int level = min(d+1, MAX_DEPTH-1);
+            report.leavesAtDepth[level] += part.leavesAtDepth[d];
+            report.splitsAtDepth[level] += part.splitsAtDepth[d];
+            report.fanOutSum[level] += part.fanOutSum[d];
+            report.imbalanceSum[level] += part.imbalanceSum[d];
+            report.imbalanceMax[level] = max(report.imbalanceMax[level], part.imbalanceMax[d]);
+        }
+        for(int k=0; k<=N_MAX; k++) report.leafOccupancy[k] += part.leafOccupancy[k];
+    }
+}
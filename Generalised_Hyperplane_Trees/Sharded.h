@@ -0,0 +1,68 @@
+#pragma once
+#include "metric_index.h"
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <sys/types.h>
+
+
+// ---------------------- Sharded Index ----------------------
+// the points split into shards, each built into an index of its own (a clone of the prototype) held by a worker
+// process of its own, so no process holds more than one shard; the router keeps a Unix socket to every worker and,
+// under pivot partitioning, the top pivots with the covering radius of their shards
+// a query visits the shards one after another, nearest lower bound first, and hands each the k-th distance found so
+// far as its radius, so every shard prunes with the bound the shards before it left; the answers are merged into the
+// caller's ResultSet, along with the computations each shard spent and what it left out
+// build forks the workers (they build their shards in parallel), the index stops them; everything runs on one machine
+class ShardedIndex : public MetricIndex{
+public:
+    // how build splits the points
+    // 0 - by a hash of the point's id, the shards are alike and every query visits all of them
+    // 1 - by nearest of shardCount pivots picked at random, as the root of a GNAT would; a query skips the shards
+    //     whose Voronoi cell or covering ball it cannot reach
+    int partitionPolicy = 1;
+    int shardCount; // takes effect at the next build, fewer shards when there are fewer points
+    // memoryBudget applies to each worker on its own
+
+    mutable std::atomic<long long> shardRequests{0}; // shard searches the router has sent
+
+    // prototype (owned) is cloned by every worker for its shard, so its kind and settings are used throughout
+    ShardedIndex(MetricIndex* prototype, int shardCount=4);
+    ShardedIndex(const ShardedIndex&) = delete;
+    ShardedIndex& operator=(const ShardedIndex&) = delete;
+    ~ShardedIndex();
+
+    const char* name() const override{
+        return "Sharded";
+    }
+
+    void build(const Point arr[], int n) override;
+    void search(const Point &q, ResultSet &result) const override;
+    void report(BuildReport &report) const override;
+    void collect(std::vector<Point> &out) const override;
+
+    // another sharded index with the same settings and workers of its own over the same points
+    MetricIndex* clone() const override;
+
+    // each point of other goes to the shard build would have put it in (widening that shard's covering radius),
+    // where the worker merges them into its index
+    void merge(const MetricIndex &other) override;
+
+private:
+    struct Shard{
+        pid_t pid = -1;
+        int fd = -1; // the router's end of the socket
+        Point pivot; // under pivot partitioning
+        float radius = 0; // every point of the shard is within this of pivot
+        int count = 0; // points in the shard
+        std::mutex lock; // one request at a time on the socket
+    };
+    std::unique_ptr<MetricIndex> prototype;
+    std::vector<std::unique_ptr<Shard>> shards;
+    long long partitionComputations = 0; // distance computations of the router in splitting the points
+
+    int shardOf(const Point &p, float &dist) const;
+    void serve(int fd, const std::vector<Point> &part);
+    void refreshStats(const IndexStats shardStats[]);
+    void stopWorkers();
+};
@@ -0,0 +1,147 @@
+#include "Tuner.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <sstream>
+using namespace std;
+using namespace chrono;
+
+
+// ---------------------- Configurations ----------------------
+MetricIndex* TuningConfig::make(int metricType) const{
+    if(kind==0) return new RandomPivotingGHT(metricType, leafSize);
+    if(kind==1) return new MaximumSeparationGHT(metricType, leafSize);
+    if(kind==2) return new ReusingPivotsMBT(metricType, leafSize);
+    GNATIndex* gnat = new GNATIndex(metricType, leafSize);
+    gnat->arity = arity;
+    gnat->pivotPolicy = pivotPolicy;
+    return gnat;
+}
+
+string TuningConfig::describe() const{
+    const char* kindNames[] = {"Random Pivoting", "Maximum Separation", "Reusing Pivots (MBT)", "GNAT"};
+    ostringstream out;
+    out<<kindNames[kind]<<", leaf size "<<leafSize;
+    if(kind==3) out<<", arity "<<arity<<(pivotPolicy ? ", farthest-first pivots" : ", random pivots");
+    return out.str();
+}
+
+
+// ---------------------- Tuner ----------------------
+// by the objective, ties going to the other measure
+static bool cheaper(const TuningTrial &x, const TuningTrial &y, int objective){
+    double a[2] = {x.predictedComputations, x.predictedMicros};
+    double b[2] = {y.predictedComputations, y.predictedMicros};
+    if(a[objective]!=b[objective]) return a[objective]<b[objective];
+    return a[1-objective]<b[1-objective];
+}
+
+// mean distance computations and search time per query of the built index over the query sample
+void AutoTuner::measure(MetricIndex &index, double &computations, double &micros) const{
+    ResultSet result(k);
+    long long total = 0;
+    auto search_start = high_resolution_clock::now();
+    for(const Point &q : queries){
+        result.reset(k);
+        index.search(q, result);
+        total += result.computations;
+    }
+    auto search_end = high_resolution_clock::now();
+    computations = (double)total/queries.size();
+    micros = duration_cast<nanoseconds>(search_end - search_start).count()/1000.0/queries.size();
+}
+
+MetricIndex* AutoTuner::tune(const Point arr[], int n, int metricType){
+    mt19937 rng(seed);
+    trials.clear();
+    best = -1;
+    if(n<=0) throw invalid_argument("AutoTuner::tune: no points to tune over");
+    if(queryCount<=0) throw invalid_argument("AutoTuner::tune: queryCount must be positive");
+
+    // the sample is a random subset, its first half is the smaller of the two trial sizes
+    int s = min(sampleSize, n);
+    vector<Point> sample(arr, arr+n);
+    for(int i=0; i<s; i++){
+        swap(sample[i], sample[i+rng()%(n-i)]);
+    }
+    sample.resize(s);
+
+    queries.assign(queryCount, Point());
+    for(Point &q : queries){
+        const Point &x = arr[rng()%n];
+        const Point &y = arr[rng()%n];
+        for(int j=0; j<D; j++){
+            q.coords[j] = (x.coords[j]+y.coords[j])/2;
+        }
+        q.id = -1;
+    }
+
+    vector<TuningConfig> grid;
+    for(int kind : kinds){
+        for(int leafSize : leafSizes){
+            TuningConfig config;
+            config.kind = kind;
+            config.leafSize = leafSize;
+            if(kind!=3){
+                grid.push_back(config);
+                continue;
+            }
+            for(int arity : arities){
+                for(int pivotPolicy : pivotPolicies){
+                    config.arity = arity;
+                    config.pivotPolicy = pivotPolicy;
+                    grid.push_back(config);
+                }
+            }
+        }
+    }
+
+    if(grid.empty()) throw invalid_argument("AutoTuner::tune: the grid of kinds, leaf sizes, arities and pivot policies is empty");
+
+    for(const TuningConfig &config : grid){
+        TuningTrial trial;
+        trial.config = config;
+        MetricIndex* index = config.make(metricType);
+        double micros;
+        index->seed = seed;
+        index->build(sample.data(), s/2);
+        measure(*index, trial.sampleComputations[0], micros);
+        index->build(sample.data(), s);
+        measure(*index, trial.sampleComputations[1], trial.sampleMicros);
+        delete index;
+
+        trial.growth = 1;
+        if(s>=4 && trial.sampleComputations[0]>0) trial.growth = log(trial.sampleComputations[1]/trial.sampleComputations[0])/log((double)s/(s/2));
+        trial.growth = max(0.0, min(1.0, trial.growth));
+        trial.predictedComputations = min((double)n, trial.sampleComputations[1]*pow((double)n/s, trial.growth));
+        trial.predictedMicros = trial.sampleMicros*trial.predictedComputations/max(1.0, trial.sampleComputations[1]);
+        trials.push_back(trial);
+        if(best<0 || cheaper(trial, trials[best], objective)) best = (int)trials.size()-1;
+    }
+
+    MetricIndex* index = trials[best].config.make(metricType);
+    index->seed = seed;
+    index->build(arr, n);
+    measure(*index, actualComputations, actualMicros);
+    return index;
+}
+
+void printTuning(const AutoTuner &tuner){
+    if(tuner.best<0) return;
+    vector<int> order(tuner.trials.size());
+    for(int i=0; i<(int)order.size(); i++) order[i] = i;
+    stable_sort(order.begin(), order.end(), [&](int a, int b){
+        return cheaper(tuner.trials[a], tuner.trials[b], tuner.objective);
+    });
+
+    cout<<fixed<<setprecision(2);
+    cout<<"Configurations tried: "<<tuner.trials.size()<<", the best five (predicted distance computations / microseconds per query, growth exponent):"<<endl;
+    for(int i=0; i<min(5, (int)order.size()); i++){
+        const TuningTrial &trial = tuner.trials[order[i]];
+        cout<<"  "<<trial.config.describe()<<": "<<trial.predictedComputations<<" / "<<trial.predictedMicros<<", "<<trial.growth<<endl;
+    }
+    const TuningTrial &chosen = tuner.trials[tuner.best];
+    cout<<"Chosen: "<<chosen.config.describe()<<endl;
+    cout<<"Predicted: "<<chosen.predictedComputations<<" distance computations, "<<chosen.predictedMicros<<" microseconds per query"<<endl;
+    cout<<"Actual: "<<tuner.actualComputations<<" distance computations, "<<tuner.actualMicros<<" microseconds per query"<<endl;
+}
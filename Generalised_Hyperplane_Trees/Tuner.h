@@ -0,0 +1,69 @@
+#pragma once
+#include "GHT.h"
+#include "GNAT.h"
+#include <string>
+
+
+// ---------------------- Configurations ----------------------
+// one point of the tuning grid
+struct TuningConfig{
+    // 0 - random pivoting GHT
+    // 1 - maximum separation GHT
+    // 2 - reusing pivots MBT
+    // 3 - GNAT
+    int kind = 0;
+    int leafSize = 4;
+    int arity = M; // GNAT only
+    int pivotPolicy = 0; // GNAT only, see GNATIndex::pivotPolicy
+
+    // a new, unbuilt index with this configuration
+    MetricIndex* make(int metricType) const;
+    std::string describe() const;
+};
+
+// what one configuration cost on the samples, and what that predicts for the full dataset
+struct TuningTrial{
+    TuningConfig config;
+    double sampleComputations[2]; // mean distance computations per query over the half sample and the full sample
+    double sampleMicros; // mean search time per query over the full sample
+    double growth; // exponent a of the fit computations ~ n^a through the two sample sizes
+    double predictedComputations; // per query over all n points
+    double predictedMicros;
+};
+
+
+// ---------------------- Tuner ----------------------
+// builds every configuration of the grid over a sample of the data and searches it with a sample of queries, then
+// builds the configuration with the cheapest predicted search over the whole dataset
+// a tree's search cost grows roughly like n^a with a between 0 (perfect pruning) and 1 (brute force); measuring it
+// at two sample sizes fixes a, which extrapolates the cost to n
+class AutoTuner{
+public:
+    int sampleSize = 512; // points the trial trees are built over
+    int queryCount = 128; // queries per trial, each the midpoint of two random data points
+    int k = 1; // neighbours per query
+    unsigned seed = 1;
+    // 0 - fewest predicted distance computations
+    // 1 - shortest predicted search time
+    int objective = 0;
+
+    std::vector<int> kinds = {0, 1, 2, 3};
+    std::vector<int> leafSizes = {1, 2, 4, 8, 16, 32};
+    std::vector<int> arities = {4, 8, 12, 16, 24, 32};
+    std::vector<int> pivotPolicies = {0, 1};
+
+    std::vector<TuningTrial> trials; // filled by tune, in grid order
+    int best = -1; // position of the chosen configuration in trials
+    double actualComputations = 0; // mean per query of the chosen index over all n points, same queries as the trials
+    double actualMicros = 0;
+
+    // tunes over arr[0..n) and returns the chosen index built over all of it (owned by the caller)
+    // throws invalid_argument when there are no points, no queries or no configuration to try
+    MetricIndex* tune(const Point arr[], int n, int metricType);
+
+private:
+    std::vector<Point> queries;
+    void measure(MetricIndex &index, double &computations, double &micros) const;
+};
+
+void printTuning(const AutoTuner &tuner);
@@ -0,0 +1,910 @@
+#include "GHT.h"
+#include "GNAT.h"
+#include "Forest.h"
+#include "Join.h"
+#include "LSM.h"
+#include "Disk.h"
+#include "Tuner.h"
+#include "Profile.h"
+#include "Scan.h"
+#include "PivotFilter.h"
+#include "Concurrent.h"
+#include "Sharded.h"
+#include "GroundTruth.h"
+#include <chrono> // measure build and search time
+#include <random> // generate pseudo random float numbers
+#include <algorithm> // sort for latency percentiles
+#include <cstdlib>
+#include <new>
+#include <cstddef>
+#include <atomic>
+#include <thread>
+using namespace std;
+using namespace chrono;
+
+// dataset.h carries its own N_MAX (the rows in DATASET), the indices keep theirs as their capacity
+#pragma push_macro("N_MAX")
+#undef N_MAX
+#include "dataset.h"
+#pragma pop_macro("N_MAX")
+
+#define ITERATIONS 2000 // average out results over 2000 iterations
+#define FOREST_ITERATIONS 200 // the forest benchmark rebuilds every tree per iteration, so it runs fewer of them
+#define VERIFY_K 10 // neighbours per query the verification asks for
+#define TRUTH_CACHE "ght_truth" // where the verification keeps its ground truth between runs
+
+// 0 - L2 distance
+// 1 - L1 distance
+// 2 - L_inf distance
+int metricType = 1;
+
+
+// ---------------------- Allocation Counter ----------------------
+// every new/new[] in the program ends up here, which lets the benchmark check that searching never allocates
+// each block carries its size in a header in front of it, so the bytes held can be followed as well
+// atomic, the concurrency benchmark allocates from several threads
+atomic<long long> heapAllocations{0};
+atomic<long long> heapBytes{0}; // held right now
+atomic<long long> heapPeak{0}; // most held at once since it was last set to heapBytes
+
+#define HEAP_HEADER alignof(max_align_t)
+
+void* operator new(size_t size){
+    heapAllocations++;
+    char* p = (char*)malloc(size+HEAP_HEADER);
+    if(!p) throw bad_alloc();
+    *(size_t*)p = size;
+    long long held = heapBytes += size;
+    if(held>heapPeak) heapPeak = held;
+    return p+HEAP_HEADER;
+}
+
+void operator delete(void* p) noexcept{
+    if(!p) return;
+    char* block = (char*)p-HEAP_HEADER;
+    heapBytes -= *(size_t*)block;
+    free(block);
+}
+
+void operator delete(void* p, size_t) noexcept{
+    operator delete(p);
+}
+
+
+// ---------------------- Benchmark ----------------------
+// query points need not be elements of the dataset; coordinates past the dataset's dimension stay 0 like the data's
+Point randomQuery(mt19937 &rng, uniform_real_distribution<float> &dist, int dims){
+    Point q;
+    for(int j=0; j<D; j++) q.coords[j] = (j<dims) ? dist(rng) : 0;
+    q.id = -1;
+    return q;
+}
+
+// builds the index afresh and answers one random query per iteration, reporting the averages
+// returns false when a search allocated, which search must never do
+bool benchmark(MetricIndex &index, const Point points[], int n, mt19937 &rng, uniform_real_distribution<float> &dist, int dims){
+    double totalBuildTime = 0, totalSearchTime = 0;
+    long long totalDistBuild = 0, totalDistSearch = 0, totalPivots = 0, totalAllocSearch = 0;
+    long long totalHeld = 0, peakBuild = 0, peakSearch = 0;
+    ResultSet result(1);
+
+    for(int iter=0; iter<ITERATIONS; iter++){
+        index.seed = (unsigned)rng(); // a different tree every iteration, the same sequence of them every run
+
+        // measure time (in microseconds) to build the index
+        auto build_start = high_resolution_clock::now();
+        index.build(points, n);
+        auto build_end = high_resolution_clock::now();
+        totalBuildTime += duration_cast<microseconds>(build_end - build_start).count();
+
+        Point q = randomQuery(rng, dist, dims);
+        result.reset(1);
+
+        // measure time (in microseconds) to search the index
+        long long allocBefore = heapAllocations;
+        long long bytesBefore = heapBytes;
+        heapPeak = bytesBefore;
+        auto search_start = high_resolution_clock::now();
+        index.search(q, result);
+        auto search_end = high_resolution_clock::now();
+        totalSearchTime += duration_cast<microseconds>(search_end - search_start).count();
+        totalAllocSearch += heapAllocations-allocBefore;
+        peakSearch = max(peakSearch, heapPeak-bytesBefore);
+        totalHeld += index.stats.memoryBytes;
+        peakBuild = max(peakBuild, index.stats.peakBuildBytes);
+
+        totalDistBuild += index.stats.computationsBuild;
+        totalDistSearch += result.computations;
+        totalPivots += index.stats.pivotCount;
+    }
+
+    cout<<fixed<<setprecision(2);
+    cout<<"\nAveraged over "<<ITERATIONS<<" iterations:"<<endl;
+    cout<<"Average build time: "<<(totalBuildTime/ITERATIONS)<<" microseconds"<<endl;
+    cout<<"Average search time: "<<(totalSearchTime/ITERATIONS)<<" microseconds"<<endl;
+    cout<<"Average distance computations in building: "<<(totalDistBuild/ITERATIONS)<<endl;
+    cout<<"Average distance computations in searching: "<<(totalDistSearch/ITERATIONS)<<endl;
+    cout<<"Average pivots used: "<<(totalPivots/ITERATIONS)<<endl;
+    cout<<"Heap allocations in searching: "<<totalAllocSearch<<(totalAllocSearch ? "  REGRESSION" : "")<<endl;
+    cout<<"Average memory held by the index: "<<(totalHeld/ITERATIONS/1024.0)<<" KB"<<endl;
+    cout<<"Peak memory in building: "<<(peakBuild/1024.0)<<" KB, in searching: "<<peakSearch<<" bytes"<<endl;
+    return totalAllocSearch==0;
+}
+
+// pivots chosen again above an imbalance threshold against every split accepted, over the same sequence of builds:
+// the resamples, what they cost in building, the worst split of each of the top levels, and the search cost
+// returns false when the threshold resampled nothing or left the worst split of one of the top levels no better; below
+// those levels the nodes are too small to be resampled
+bool resampleBenchmark(MetricIndex &index, float &maxImbalance, float threshold, int levels, const Point points[], int n, mt19937 &rng, uniform_real_distribution<float> &dist, int dims){
+    const int builds = ITERATIONS/10;
+    unsigned seeds[builds];
+    Point queries[builds];
+    for(int b=0; b<builds; b++){
+        seeds[b] = (unsigned)rng();
+        queries[b] = randomQuery(rng, dist, dims);
+    }
+    float worst[2][MAX_DEPTH] = {};
+    long long resamples[2] = {}, buildComputations[2] = {}, searchComputations[2] = {};
+    BuildReport* report = new BuildReport;
+    ResultSet result(1);
+    float thresholds[2] = {1, threshold};
+    for(int t=0; t<2; t++){
+        maxImbalance = thresholds[t];
+        for(int b=0; b<builds; b++){
+            index.seed = seeds[b];
+            index.build(points, n);
+            *report = BuildReport();
+            index.report(*report);
+            for(int d=0; d<levels; d++) worst[t][d] = max(worst[t][d], report->imbalanceMax[d]);
+            resamples[t] += index.stats.resampleCount;
+            buildComputations[t] += index.stats.computationsBuild;
+            result.reset(1);
+            index.search(queries[b], result);
+            searchComputations[t] += result.computations;
+        }
+    }
+    maxImbalance = 1;
+    delete report;
+
+    bool passed = resamples[1]>0;
+    cout<<"\n"<<index.name()<<", pivots resampled above an imbalance of "<<threshold<<", "<<builds<<" builds:"<<endl;
+    for(int t=0; t<2; t++){
+        cout<<(t==0 ? "Every split accepted: " : "Resampled: ")<<((double)resamples[t]/builds)<<" resamples, "
+            <<((double)buildComputations[t]/builds)<<" distance computations in building, "<<((double)searchComputations[t]/builds)
+            <<" in searching, worst imbalance of the top "<<levels<<" levels:";
+        for(int d=0; d<levels; d++) cout<<" "<<worst[t][d];
+        cout<<endl;
+    }
+    for(int d=0; d<levels; d++) passed &= worst[1][d]<worst[0][d];
+    if(!passed) cout<<"REGRESSION: resampling left the splits no better balanced"<<endl;
+    return passed;
+}
+
+// the same queries answered by following the TreeNode pointers and by each contiguous layout of one tree
+void layoutBenchmark(GHTIndex &index, const Point points[], int n, mt19937 &rng, uniform_real_distribution<float> &dist, int dims){
+    index.layoutOrder = 0;
+    index.build(points, n);
+    Point* queries = new Point[ITERATIONS];
+    for(int i=0; i<ITERATIONS; i++) queries[i] = randomQuery(rng, dist, dims);
+    ResultSet result(1);
+
+    const char* names[] = {"pointer tree", "breadth-first layout", "van Emde Boas layout"};
+    cout<<"\n"<<index.name()<<" search time by node layout, "<<ITERATIONS<<" queries:"<<endl;
+    for(int order=0; order<3; order++){
+        index.relayout(order);
+        auto search_start = high_resolution_clock::now();
+        for(int i=0; i<ITERATIONS; i++){
+            result.reset(1);
+            index.search(queries[i], result);
+        }
+        auto search_end = high_resolution_clock::now();
+        double total = duration_cast<nanoseconds>(search_end - search_start).count();
+        cout<<names[order]<<": "<<(total/ITERATIONS/1000)<<" microseconds per query"<<endl;
+    }
+
+    ResultSet* results = new ResultSet[ITERATIONS];
+    index.relayout(1);
+    auto search_start = high_resolution_clock::now();
+    index.searchBatch(queries, results, ITERATIONS);
+    auto search_end = high_resolution_clock::now();
+    double total = duration_cast<nanoseconds>(search_end - search_start).count();
+    cout<<"breadth-first layout, "<<index.batchGroup<<" queries interleaved: "<<(total/ITERATIONS/1000)<<" microseconds per query"<<endl;
+    delete []results;
+
+    index.relayout(0);
+    delete []queries;
+}
+
+// 10-NN searches cut short by a computation budget or a deadline against the exact answers: how often the answer is
+// still exact, how far its k-th distance is from the true one, and how far the guarantee says it could be at worst
+void deadlineBenchmark(MetricIndex &index, const Point points[], int n, mt19937 &rng, uniform_real_distribution<float> &dist, int dims){
+    const int k = 10;
+    index.build(points, n);
+    Point* queries = new Point[ITERATIONS];
+    float* exact = new float[ITERATIONS];
+    ResultSet result(k);
+    long long exactComputations = 0;
+    for(int i=0; i<ITERATIONS; i++){
+        queries[i] = randomQuery(rng, dist, dims);
+        result.reset(k);
+        index.search(queries[i], result);
+        exact[i] = result.bound();
+        exactComputations += result.computations;
+    }
+
+    long long budgets[] = {32, 128, 512, -1, -1, -1};
+    long long deadlines[] = {-1, -1, -1, 2, 5, 20}; // microseconds
+    cout<<"\n"<<index.name()<<", "<<k<<"-NN searches cut short, "<<(double)exactComputations/ITERATIONS<<" computations for the exact answer:"<<endl;
+    for(int c=0; c<6; c++){
+        int exactCount = 0, violations = 0;
+        double found = 0, guaranteed = 0; // summed ratios of the answer's and the lower bound's k-th distance to the true one
+        for(int i=0; i<ITERATIONS; i++){
+            result.reset(k, numeric_limits<float>::infinity(), budgets[c]);
+            if(deadlines[c]>=0) result.expireAfter(deadlines[c]);
+            index.search(queries[i], result);
+            if(result.bound()<=exact[i]) exactCount++;
+            if(result.lowerBound()>exact[i]) violations++;
+            if(exact[i]>0){
+                found += min(result.bound()/exact[i], 10.0f); // an incomplete answer counts as 10 times too far
+                guaranteed += result.lowerBound()/exact[i];
+            }
+        }
+        if(budgets[c]>=0) cout<<"Budget of "<<budgets[c]<<" computations: ";
+        else cout<<"Deadline of "<<deadlines[c]<<" microseconds: ";
+        cout<<(100.0*exactCount/ITERATIONS)<<"% exact, k-th distance "<<(found/ITERATIONS)<<" times the true one, proven at least "
+            <<(guaranteed/ITERATIONS)<<" times it"<<(violations ? " (LOWER BOUND VIOLATED in "+to_string(violations)+" queries)" : "")<<endl;
+    }
+    delete []queries;
+    delete []exact;
+}
+
+// GNAT shards served by worker processes against one GNAT over all the points, both partition policies; a query's
+// distance computations include those of the router and of every shard it visits
+void shardBenchmark(const Point points[], int n, mt19937 &rng, uniform_real_distribution<float> &dist, int dims){
+    const int k = 10;
+    GNATIndex single(metricType);
+    single.build(points, n);
+    Point* queries = new Point[ITERATIONS];
+    float* exact = new float[ITERATIONS];
+    ResultSet result(k);
+    long long singleComputations = 0;
+    for(int i=0; i<ITERATIONS; i++){
+        queries[i] = randomQuery(rng, dist, dims);
+        result.reset(k);
+        single.search(queries[i], result);
+        exact[i] = result.bound();
+        singleComputations += result.computations;
+    }
+
+    const char* policyNames[] = {"hash", "top pivot"};
+    ShardedIndex sharded(new GNATIndex(metricType), 4);
+    cout<<"\n"<<sharded.shardCount<<" GNAT shards in worker processes, "<<k<<"-NN, "<<ITERATIONS<<" queries (one GNAT: "
+        <<(double)singleComputations/ITERATIONS<<" computations per query):"<<endl;
+    for(int policy=0; policy<2; policy++){
+        sharded.partitionPolicy = policy;
+        auto build_start = high_resolution_clock::now();
+        sharded.build(points, n);
+        auto build_end = high_resolution_clock::now();
+        sharded.shardRequests = 0;
+        long long computations = 0;
+        int wrong = 0;
+        auto search_start = high_resolution_clock::now();
+        for(int i=0; i<ITERATIONS; i++){
+            result.reset(k);
+            sharded.search(queries[i], result);
+            computations += result.computations;
+            if(result.bound()!=exact[i]) wrong++;
+        }
+        auto search_end = high_resolution_clock::now();
+        cout<<"By "<<policyNames[policy]<<": build "<<duration_cast<microseconds>(build_end - build_start).count()<<" microseconds, "
+            <<(double)computations/ITERATIONS<<" computations and "<<(double)sharded.shardRequests/ITERATIONS<<" shards per query, "
+            <<(duration_cast<nanoseconds>(search_end - search_start).count()/1000.0/ITERATIONS)<<" microseconds per query, "
+            <<wrong<<" answers differing from one GNAT"<<endl;
+    }
+    delete []queries;
+    delete []exact;
+}
+
+// forest vs its first tree alone: per query distance computations and search time, rebuilt every iteration
+// so that the spread includes the variance coming from random pivots
+void forestBenchmark(Forest &forest, const Point points[], int n, mt19937 &rng, uniform_real_distribution<float> &dist, int dims){
+    int* singleCost = new int[FOREST_ITERATIONS];
+    int* forestCost[2] = {new int[FOREST_ITERATIONS], new int[FOREST_ITERATIONS]};
+    double singleTime = 0, forestTime[2] = {0, 0};
+    int forestMisses = 0; // approximate answers that were not the true nearest neighbour
+    ResultSet result(1);
+
+    for(int iter=0; iter<FOREST_ITERATIONS; iter++){
+        forest.seed = (unsigned)rng();
+        forest.build(points, n);
+        Point q = randomQuery(rng, dist, dims);
+
+        // the single tree is searched last, so it is the one that benefits from a warm cache
+        float approxDist = 0;
+        for(int mode=0; mode<2; mode++){
+            forest.forestMode = mode;
+            result.reset(1);
+            auto search_start = high_resolution_clock::now();
+            forest.search(q, result);
+            auto search_end = high_resolution_clock::now();
+            forestTime[mode] += duration_cast<microseconds>(search_end - search_start).count();
+            forestCost[mode][iter] = result.computations;
+            if(mode==1) approxDist = result.bound();
+        }
+
+        result.reset(1);
+        auto search_start = high_resolution_clock::now();
+        forest.trees[0]->search(q, result);
+        auto search_end = high_resolution_clock::now();
+        singleTime += duration_cast<microseconds>(search_end - search_start).count();
+        singleCost[iter] = result.computations;
+        if(approxDist>result.bound()) forestMisses++;
+    }
+    forest.forestMode = 0;
+
+    const char* names[] = {"Single tree", "Exact forest", "Approximate forest"};
+    int* costs[] = {singleCost, forestCost[0], forestCost[1]};
+    double times[] = {singleTime, forestTime[0], forestTime[1]};
+    cout<<"\nForest of "<<forest.trees.size()<<" trees ("<<forest.treeBudget<<" computations per tree when approximate), "<<FOREST_ITERATIONS<<" iterations:"<<endl;
+    for(int k=0; k<3; k++){
+        sort(costs[k], costs[k]+FOREST_ITERATIONS);
+        cout<<names[k]<<": average search time "<<(times[k]/FOREST_ITERATIONS)<<" microseconds, distance computations p50 "
+            <<costs[k][FOREST_ITERATIONS/2]<<", p99 "<<costs[k][FOREST_ITERATIONS*99/100]<<", max "<<costs[k][FOREST_ITERATIONS-1]<<endl;
+    }
+    cout<<"Approximate forest missed the nearest neighbour in "<<forestMisses<<" of "<<FOREST_ITERATIONS<<" queries"<<endl;
+    delete []singleCost;
+    delete []forestCost[0];
+    delete []forestCost[1];
+}
+
+
+// all nearest neighbours of the dataset: one search per point against the dual-tree join, then a self-join
+// at the median nearest neighbour distance; returns false when a join, covering radii included, makes more distance
+// computations than the searches or than measuring every pair
+template<typename Index>
+bool joinBenchmark(Index &index, const Point points[], int n){
+    index.build(points, n);
+    JoinTree tree(index);
+    int threads = max(1, (int)thread::hardware_concurrency());
+
+    // each point finds itself first, so its nearest neighbour is the second result
+    long long singleCost = 0;
+    vector<float> nearestDist(n);
+    ResultSet result(2);
+    auto single_start = high_resolution_clock::now();
+    for(int i=0; i<n; i++){
+        result.reset(2);
+        index.search(points[i], result);
+        singleCost += result.computations;
+        nearestDist[i] = result.bound();
+    }
+    auto single_end = high_resolution_clock::now();
+
+    vector<JoinPair> nearest;
+    auto join_start = high_resolution_clock::now();
+    long long joinCost = allNearestNeighbours(tree, tree, true, nearest, 1);
+    auto join_end = high_resolution_clock::now();
+    allNearestNeighbours(tree, tree, true, nearest, threads);
+    auto parallel_end = high_resolution_clock::now();
+
+    sort(nearestDist.begin(), nearestDist.end());
+    float r = nearestDist[n/2];
+    vector<JoinPair> pairs;
+    auto range_start = high_resolution_clock::now();
+    long long rangeCost = similarityJoin(tree, tree, r, true, pairs, threads);
+    auto range_end = high_resolution_clock::now();
+
+    cout<<"\nAll nearest neighbours over "<<index.name()<<" ("<<n<<" points, "<<tree.computationsBuild<<" computations for the covering radii):"<<endl;
+    cout<<"One search per point: "<<duration_cast<microseconds>(single_end - single_start).count()<<" microseconds, "<<singleCost<<" distance computations"<<endl;
+    cout<<"Dual-tree join: "<<duration_cast<microseconds>(join_end - join_start).count()<<" microseconds, "<<joinCost<<" distance computations, "
+        <<duration_cast<microseconds>(parallel_end - join_end).count()<<" microseconds on "<<threads<<" threads"<<endl;
+    cout<<"Self-join within "<<r<<": "<<pairs.size()<<" pairs, "<<duration_cast<microseconds>(range_end - range_start).count()<<" microseconds, "
+        <<rangeCost<<" distance computations ("<<((long long)n*(n-1)/2)<<" pairs in all)"<<endl;
+    bool passed = tree.computationsBuild+joinCost<=singleCost && tree.computationsBuild+rangeCost<=(long long)n*(n-1)/2;
+    if(!passed) cout<<"REGRESSION: a join made more distance computations than it saves"<<endl;
+    return passed;
+}
+
+
+// the dataset arriving in 10 batches: rebuilding over everything after each batch, merging each batch into
+// one index, and an LSM index whose merges run in the background
+void ingestBenchmark(const MetricIndex &prototype, const Point points[], int n){
+    const int batches = 10;
+    long long rebuildCost = 0, mergeCost = 0;
+    double rebuildTime = 0, mergeTime = 0, insertTime = 0, insertMax = 0;
+    MetricIndex* rebuilt = prototype.clone();
+    MetricIndex* merged = prototype.clone();
+    MetricIndex* batch = prototype.clone();
+    LSMIndex lsm(prototype.clone());
+
+    for(int b=0; b<batches; b++){
+        int first = n*b/batches, last = n*(b+1)/batches;
+
+        auto rebuild_start = high_resolution_clock::now();
+        rebuilt->build(points, last);
+        auto rebuild_end = high_resolution_clock::now();
+        rebuildTime += duration_cast<microseconds>(rebuild_end - rebuild_start).count();
+        rebuildCost += rebuilt->stats.computationsBuild;
+
+        auto merge_start = high_resolution_clock::now();
+        if(b==0) merged->build(points, last);
+        else{
+            batch->build(points+first, last-first);
+            mergeCost += batch->stats.computationsBuild;
+            merged->merge(*batch);
+        }
+        auto merge_end = high_resolution_clock::now();
+        mergeTime += duration_cast<microseconds>(merge_end - merge_start).count();
+
+        auto insert_start = high_resolution_clock::now();
+        lsm.insert(points+first, last-first);
+        auto insert_end = high_resolution_clock::now();
+        double took = duration_cast<microseconds>(insert_end - insert_start).count();
+        insertTime += took;
+        insertMax = max(insertMax, took);
+    }
+    mergeCost += merged->stats.computationsBuild;
+    lsm.wait();
+
+    cout<<"\nIngesting "<<n<<" points in "<<batches<<" batches into "<<prototype.name()<<":"<<endl;
+    cout<<"Rebuild after every batch: "<<rebuildTime<<" microseconds, "<<rebuildCost<<" distance computations"<<endl;
+    cout<<"Merge every batch into one index: "<<mergeTime<<" microseconds, "<<mergeCost<<" distance computations"<<endl;
+    cout<<"LSM index: "<<insertTime<<" microseconds in inserts (slowest "<<insertMax<<"), "<<lsm.stats.computationsBuild
+        <<" distance computations including background merges, "<<lsm.indexCount()<<" live indices"<<endl;
+
+    const MetricIndex* indices[] = {rebuilt, merged, &lsm};
+    const char* names[] = {"rebuilt", "merged", "LSM"};
+    ResultSet result(1);
+    mt19937 rng(1);
+    for(int k=0; k<3; k++){
+        long long cost = 0;
+        for(int i=0; i<n; i++){
+            result.reset(1);
+            indices[k]->search(points[rng()%n], result);
+            cost += result.computations;
+        }
+        cout<<"Average distance computations of a 1-NN search, "<<names[k]<<": "<<((double)cost/n)<<endl;
+    }
+    delete rebuilt;
+    delete merged;
+    delete batch;
+}
+
+
+// a cold disk-resident GHT with one page per leaf, under a page cache budget of the whole file, a quarter of it
+// and a single block, where a larger cache must not read more blocks; then two clones rebuilt over the two halves of the
+// points, each of which must still find its own points, which fails when the clones share a file; returns false on
+// either failure
+bool diskBenchmark(const Point points[], int n, mt19937 &rng, uniform_real_distribution<float> &dist, int dims){
+    DiskGHT disk(new RandomPivotingGHT(metricType, DISK_PAGE/sizeof(Point)), "ght_leaves.bin");
+    disk.build(points, n);
+    long long budgets[] = {disk.fileBytes(), disk.fileBytes()/4, 0};
+    const char* budgetNames[] = {"the whole file", "a quarter of the file", "one block"};
+    long long reads[3];
+    double* latency = new double[ITERATIONS];
+    ResultSet result(1);
+
+    cout<<"\n"<<disk.name()<<" ("<<disk.leaves.size()<<" leaf blocks, "<<(disk.fileBytes()/1024.0)<<" KB on disk, "<<disk.readAhead<<" reads in flight per query):"<<endl;
+    for(int b=0; b<3; b++){
+        disk.cacheBudget = budgets[b];
+        disk.dropCache();
+        disk.blockReads = 0;
+        long long computations = 0;
+        double total = 0;
+        for(int iter=0; iter<ITERATIONS; iter++){
+            Point q = randomQuery(rng, dist, dims);
+            result.reset(1);
+            auto search_start = high_resolution_clock::now();
+            disk.search(q, result);
+            auto search_end = high_resolution_clock::now();
+            latency[iter] = duration_cast<nanoseconds>(search_end - search_start).count()/1000.0;
+            total += latency[iter];
+            computations += result.computations;
+        }
+        sort(latency, latency+ITERATIONS);
+        cout<<"Cache budget of "<<budgetNames[b]<<": "<<(ITERATIONS/(total/1e6))<<" queries per second, p50 "<<latency[ITERATIONS/2]
+            <<" / p99 "<<latency[ITERATIONS*99/100]<<" microseconds, "<<((double)disk.blockReads/ITERATIONS)<<" block reads and "
+            <<((double)computations/ITERATIONS)<<" distance computations per query"<<endl;
+        reads[b] = disk.blockReads;
+    }
+    delete []latency;
+    bool passed = reads[0]<=reads[1] && reads[1]<=reads[2];
+    if(!passed) cout<<"REGRESSION: a larger cache read more blocks"<<endl;
+
+    unique_ptr<MetricIndex> halves[2] = {unique_ptr<MetricIndex>(disk.clone()), unique_ptr<MetricIndex>(disk.clone())};
+    halves[0]->build(points, n/2);
+    halves[1]->build(points+n/2, n-n/2);
+    int lost = 0;
+    for(int i=0; i<n; i++){
+        result.reset(1);
+        halves[i<n/2 ? 0 : 1]->search(points[i], result);
+        vector<Neighbor> found = result.sorted();
+        if(found.empty() || found[0].dist>0) lost++;
+    }
+    passed &= lost==0;
+    cout<<"Two clones over the halves of the points: "<<lost<<" points not found in their own half"<<(lost==0 ? "" : "  REGRESSION")<<endl;
+    return passed;
+}
+
+
+// the exact scan three ways: a plain loop over distance(), the linear scan engine one query at a time, and batched
+void scanBenchmark(const Point points[], int n, mt19937 &rng, uniform_real_distribution<float> &dist, int dims){
+    LinearScan scan(metricType);
+    scan.build(points, n);
+    Point* queries = new Point[ITERATIONS];
+    for(int i=0; i<ITERATIONS; i++) queries[i] = randomQuery(rng, dist, dims);
+    ResultSet* results = new ResultSet[ITERATIONS];
+    double checksum = 0; // keeps the plain loop from being optimised away
+
+    auto loop_start = high_resolution_clock::now();
+    for(int i=0; i<ITERATIONS; i++){
+        float best = numeric_limits<float>::infinity();
+        for(int j=0; j<n; j++){
+            best = min(best, distance(queries[i], points[j], metricType));
+        }
+        checksum += best;
+    }
+    auto loop_end = high_resolution_clock::now();
+    for(int i=0; i<ITERATIONS; i++){
+        results[i].reset(1);
+        scan.search(queries[i], results[i]);
+    }
+    auto single_end = high_resolution_clock::now();
+    for(int i=0; i<ITERATIONS; i++) results[i].reset(1);
+    scan.searchBatch(queries, results, ITERATIONS);
+    auto batch_end = high_resolution_clock::now();
+    for(int i=0; i<ITERATIONS; i++) checksum -= results[i].bound();
+
+    cout<<"\nExact scan over "<<n<<" points, "<<ITERATIONS<<" queries (checksum "<<checksum<<"):"<<endl;
+    cout<<"Plain loop: "<<(duration_cast<nanoseconds>(loop_end - loop_start).count()/1000.0/ITERATIONS)<<" microseconds per query"<<endl;
+    cout<<scan.name()<<": "<<(duration_cast<nanoseconds>(single_end - loop_end).count()/1000.0/ITERATIONS)<<" microseconds per query"<<endl;
+    cout<<scan.name()<<", blocks of "<<scan.queryBlock<<" queries x "<<scan.pointBlock<<" points on "<<max(1, (int)thread::hardware_concurrency())
+        <<" threads: "<<(duration_cast<nanoseconds>(batch_end - single_end).count()/1000.0/ITERATIONS)<<" microseconds per query"<<endl;
+    delete []queries;
+    delete []results;
+}
+
+
+// the pivot-space filter at several embedding sizes against a plain loop over distance(); the filtering ratio is
+// the share of the non-pivot points whose lower bound spared computing their distance
+void filterBenchmark(const Point points[], int n, mt19937 &rng, uniform_real_distribution<float> &dist, int dims){
+    Point* queries = new Point[ITERATIONS];
+    for(int i=0; i<ITERATIONS; i++) queries[i] = randomQuery(rng, dist, dims);
+    double checksum = 0;
+
+    auto loop_start = high_resolution_clock::now();
+    for(int i=0; i<ITERATIONS; i++){
+        float best = numeric_limits<float>::infinity();
+        for(int j=0; j<n; j++){
+            best = min(best, distance(queries[i], points[j], metricType));
+        }
+        checksum += best;
+    }
+    auto loop_end = high_resolution_clock::now();
+    double loopMicros = duration_cast<nanoseconds>(loop_end - loop_start).count()/1000.0/ITERATIONS;
+
+    cout<<"\nPivot-space filter over "<<n<<" points, "<<ITERATIONS<<" queries:"<<endl;
+    cout<<"Plain loop: "<<loopMicros<<" microseconds per query"<<endl;
+    ResultSet result(1);
+    for(int pivotCount : {4, 8, 16, 32}){
+        PivotFilter filter(metricType, pivotCount);
+        filter.build(points, n);
+        long long computations = 0;
+        auto search_start = high_resolution_clock::now();
+        for(int i=0; i<ITERATIONS; i++){
+            result.reset(1);
+            filter.search(queries[i], result);
+            computations += result.computations;
+            checksum -= result.bound();
+        }
+        auto search_end = high_resolution_clock::now();
+        double micros = duration_cast<nanoseconds>(search_end - search_start).count()/1000.0/ITERATIONS;
+        int m = filter.stats.pivotCount;
+        double filtered = (n>m) ? 1-((double)computations/ITERATIONS-m)/(n-m) : 0;
+        cout<<pivotCount<<" pivots: "<<(double)computations/ITERATIONS<<" distance computations, "<<(100*filtered)<<"% filtered, "
+            <<micros<<" microseconds per query, "<<(loopMicros/micros)<<"x the plain loop"<<endl;
+    }
+    cout<<"(checksum "<<checksum<<")"<<endl;
+    delete []queries;
+}
+
+// search latency and distance computations of a concurrent GHT with readers alone, with a writer inserting random
+// points the whole time, and with readers alone again over the grown tree, which separates the cost of contention
+// from that of growth
+void concurrencyBenchmark(const Point points[], int n, mt19937 &rng, uniform_real_distribution<float> &dist, int dims){
+    const int readers = 2;
+    ConcurrentGHT tree(metricType);
+    tree.build(points, n);
+    Point* queries = new Point[ITERATIONS];
+    for(int i=0; i<ITERATIONS; i++) queries[i] = randomQuery(rng, dist, dims);
+    const int streamSize = 4*n; // inserts stop here if the readers are still going
+    Point* stream = new Point[streamSize];
+    for(int i=0; i<streamSize; i++){
+        stream[i] = randomQuery(rng, dist, dims);
+        stream[i].id = n+i;
+    }
+    double* latency = new double[readers*ITERATIONS];
+    long long computations[readers];
+
+    cout<<"\nConcurrent GHT, "<<readers<<" readers with "<<ITERATIONS<<" queries each:"<<endl;
+    const char* phaseNames[] = {"readers alone", "with one writer inserting", "readers alone after the inserts"};
+    for(int phase=0; phase<3; phase++){
+        atomic<bool> reading(true);
+        atomic<int> inserted(0);
+        vector<thread> pool;
+        auto phase_start = high_resolution_clock::now();
+        for(int r=0; r<readers; r++){
+            pool.emplace_back([&, r](){
+                ResultSet result(1);
+                computations[r] = 0;
+                for(int i=0; i<ITERATIONS; i++){
+                    result.reset(1);
+                    auto search_start = high_resolution_clock::now();
+                    tree.search(queries[i], result);
+                    auto search_end = high_resolution_clock::now();
+                    latency[r*ITERATIONS+i] = duration_cast<nanoseconds>(search_end - search_start).count()/1000.0;
+                    computations[r] += result.computations;
+                }
+            });
+        }
+        thread writer;
+        if(phase==1){
+            writer = thread([&](){
+                for(int i=0; reading && i<streamSize; i++){
+                    tree.insert(stream[i]);
+                    inserted++;
+                }
+            });
+        }
+        for(thread &t : pool) t.join();
+        auto phase_end = high_resolution_clock::now();
+        reading = false;
+        if(writer.joinable()) writer.join();
+
+        double seconds = duration_cast<microseconds>(phase_end - phase_start).count()/1e6;
+        sort(latency, latency+readers*ITERATIONS);
+        long long total = 0;
+        for(int r=0; r<readers; r++) total += computations[r];
+        cout<<phaseNames[phase]<<": p50 "<<latency[readers*ITERATIONS/2]<<" / p99 "<<latency[readers*ITERATIONS*99/100]<<" microseconds, "
+            <<((double)total/(readers*ITERATIONS))<<" distance computations per query";
+        if(phase==1) cout<<", "<<inserted<<" inserts ("<<(inserted/seconds)<<" per second)";
+        cout<<", "<<tree.stats.pointCount<<" points"<<endl;
+    }
+    cout<<"Replaced leaves awaiting reclamation: "<<tree.pendingReclamation();
+    tree.reclaim();
+    cout<<", "<<tree.pendingReclamation()<<" once the readers are gone"<<endl;
+
+    // the shape inserts grow against one built over the same points at once
+    MetricIndex* rebuilt = tree.clone();
+    ResultSet result(1);
+    long long rebuiltCost = 0;
+    for(int i=0; i<ITERATIONS; i++){
+        result.reset(1);
+        rebuilt->search(queries[i], result);
+        rebuiltCost += result.computations;
+    }
+    cout<<"Rebuilt over the same "<<rebuilt->stats.pointCount<<" points: "<<((double)rebuiltCost/ITERATIONS)<<" distance computations per query"<<endl;
+    delete rebuilt;
+    delete []queries;
+    delete []stream;
+    delete []latency;
+}
+
+
+// recall@VERIFY_K and distance ratio of every variant against the exact answers to the same ITERATIONS queries
+// the exact variants must answer exactly; the approximate forest and budgeted searches must keep the floor they were
+// measured at (recall and ratio over a few seeds on the bundled dataset, with a margin), so a change that loses
+// accuracy fails the run rather than showing up only as a faster number
+bool verifyBenchmark(const Point points[], int n, mt19937 &rng, uniform_real_distribution<float> &dist, int dims){
+    Point* queries = new Point[ITERATIONS];
+    for(int i=0; i<ITERATIONS; i++) queries[i] = randomQuery(rng, dist, dims);
+    auto truth_start = high_resolution_clock::now();
+    GroundTruth truth = groundTruth(points, n, queries, ITERATIONS, VERIFY_K, metricType, TRUTH_CACHE);
+    auto truth_end = high_resolution_clock::now();
+    ResultSet* results = new ResultSet[ITERATIONS];
+    bool passed = true;
+
+    // budget -1 searches in full
+    auto verify = [&](const char* name, const MetricIndex &index, long long budget, AccuracyFloor floor){
+        for(int i=0; i<ITERATIONS; i++){
+            results[i].reset(VERIFY_K, numeric_limits<float>::infinity(), budget);
+            index.search(queries[i], results[i]);
+        }
+        passed &= checkAccuracy(name, measureAccuracy(truth, results, ITERATIONS), floor);
+    };
+
+    cout<<"\nAccuracy against the ground truth, "<<VERIFY_K<<" neighbours of "<<ITERATIONS<<" queries ("
+        <<duration_cast<milliseconds>(truth_end - truth_start).count()<<" milliseconds to compute or load it):"<<endl;
+    AccuracyFloor exact;
+
+    RandomPivotingGHT randomPivoting(metricType);
+    MaximumSeparationGHT maximumSeparation(metricType);
+    ReusingPivotsMBT reusingPivots(metricType);
+    GNATIndex gnat(metricType);
+    MetricIndex* indices[] = {&randomPivoting, &maximumSeparation, &reusingPivots, &gnat};
+    for(MetricIndex* index : indices){
+        index->build(points, n);
+        verify(index->name(), *index, -1, exact);
+    }
+    gnat.arityPolicy = gnat.pivotPolicy = 1;
+    gnat.build(points, n);
+    verify("GNAT, adaptive arity, farthest-first pivots", gnat, -1, exact);
+    randomPivoting.splitRule = 2;
+    randomPivoting.build(points, n);
+    verify("Random Pivoting GHT, per node splits", randomPivoting, -1, exact);
+
+    PivotFilter filter(metricType);
+    filter.build(points, n);
+    verify(filter.name(), filter, -1, exact);
+
+    Forest forest(metricType);
+    forest.add(new RandomPivotingGHT(metricType));
+    forest.add(new ReusingPivotsMBT(metricType));
+    forest.add(new GNATIndex(metricType));
+    forest.build(points, n);
+    verify("Forest, exact", forest, -1, exact);
+    forest.forestMode = 1;
+    verify("Forest, approximate", forest, -1, {0.96, 1.01});
+
+    ConcurrentGHT concurrent(metricType);
+    concurrent.build(points, n);
+    verify(concurrent.name(), concurrent, -1, exact);
+
+    ShardedIndex sharded(new RandomPivotingGHT(metricType));
+    sharded.build(points, n);
+    verify(sharded.name(), sharded, -1, exact);
+
+    {
+        DiskGHT disk(new RandomPivotingGHT(metricType, DISK_PAGE/sizeof(Point)), "ght_leaves.bin");
+        disk.build(points, n);
+        verify(disk.name(), disk, -1, exact);
+    }
+
+    // a budget of a tenth of the points, below what an exact search takes
+    verify("Random Pivoting GHT, per node splits, budget of n/10", randomPivoting, n/10, {0.22, 1.30});
+    verify("GNAT, budget of n/10", gnat, n/10, {0.22, 1.30});
+
+    cout<<(passed ? "All variants kept their accuracy" : "FAILED: accuracy regressed")<<endl;
+    delete []queries;
+    delete []results;
+    return passed;
+}
+
+// the seed is the first argument, 1 by default; runs with the same seed build the same trees and ask the same queries
+int main(int argc, char* argv[]){
+    unsigned seed = (argc>1) ? (unsigned)strtoul(argv[1], nullptr, 10) : 1;
+
+    // "importing" the dataset, dimensions past the dataset's are left at 0 which leaves every distance unchanged
+    const int n = min((int)(sizeof(DATASET)/sizeof(DATASET[0])), N_MAX);
+    const int dims = min(D, D_MAX);
+    Point* points = new Point[n];
+    for(int i=0; i<n; i++){
+        for(int j=0; j<D; j++){
+            points[i].coords[j] = (j<dims) ? DATASET[i][j] : 0;
+        }
+        points[i].id = i;
+    }
+
+    // generate pseudo-random float values
+    mt19937 rng(seed);
+    uniform_real_distribution<float> dist(-10.0f, 10.0f);
+
+    RandomPivotingGHT randomPivoting(metricType);
+    MaximumSeparationGHT maximumSeparation(metricType);
+    ReusingPivotsMBT reusingPivots(metricType);
+    GNATIndex gnat(metricType);
+    MetricIndex* indices[] = {&randomPivoting, &maximumSeparation, &reusingPivots, &gnat};
+
+    bool allocationFree = true;
+    for(MetricIndex* index : indices){
+        cout<<"\n"<<index->name()<<":";
+        allocationFree &= benchmark(*index, points, n, rng, dist, dims);
+    }
+
+    // compare the GNAT arity and pivot selection policies
+    const char* arityNames[] = {"fixed", "adaptive"};
+    const char* pivotNames[] = {"random", "farthest-first"};
+    for(int p=0; p<2; p++){
+        for(int a=0; a<2; a++){
+            if(a==0 && p==0) continue; // the plain GNAT run above
+            gnat.arityPolicy = a;
+            gnat.pivotPolicy = p;
+            cout<<"\nGNAT, "<<arityNames[a]<<" arity, "<<pivotNames[p]<<" pivots:";
+            allocationFree &= benchmark(gnat, points, n, rng, dist, dims);
+        }
+    }
+    gnat.arityPolicy = gnat.pivotPolicy = 0;
+
+    // vantage point splits everywhere, and chosen per node against hyperplane splits
+    const char* splitNames[] = {"hyperplane", "vantage point", "per node"};
+    GHTIndex* splitting[] = {&randomPivoting, &maximumSeparation};
+    for(GHTIndex* index : splitting){
+        for(int rule=1; rule<3; rule++){
+            index->splitRule = rule;
+            cout<<"\n"<<index->name()<<", "<<splitNames[rule]<<" splits:";
+            allocationFree &= benchmark(*index, points, n, rng, dist, dims);
+        }
+        index->splitRule = 0;
+    }
+
+    bool balanced = resampleBenchmark(randomPivoting, randomPivoting.maxImbalance, 0.2f, 2, points, n, rng, dist, dims);
+    balanced &= resampleBenchmark(gnat, gnat.maxImbalance, 0.15f, 1, points, n, rng, dist, dims);
+    layoutBenchmark(randomPivoting, points, n, rng, dist, dims);
+    deadlineBenchmark(randomPivoting, points, n, rng, dist, dims);
+    deadlineBenchmark(gnat, points, n, rng, dist, dims);
+    scanBenchmark(points, n, rng, dist, dims);
+    filterBenchmark(points, n, rng, dist, dims);
+
+    // a forest mixing randomised GHTs with a GNAT
+    Forest forest(metricType);
+    forest.add(new RandomPivotingGHT(metricType));
+    forest.add(new ReusingPivotsMBT(metricType));
+    forest.add(new RandomPivotingGHT(metricType));
+    forest.add(new GNATIndex(metricType));
+    forestBenchmark(forest, points, n, rng, dist, dims);
+
+    bool joinsPay = joinBenchmark(randomPivoting, points, n);
+    joinsPay &= joinBenchmark(gnat, points, n);
+
+    ingestBenchmark(randomPivoting, points, n);
+    ingestBenchmark(gnat, points, n);
+
+    bool diskSound = diskBenchmark(points, n, rng, dist, dims);
+    shardBenchmark(points, n, rng, dist, dims);
+    concurrencyBenchmark(points, n, rng, dist, dims);
+    bool accurate = verifyBenchmark(points, n, rng, dist, dims);
+
+    cout<<"\nDistance profile of the dataset:"<<endl;
+    for(int metric=0; metric<3; metric++){
+        printProfile(profileDistances(points, n, metric));
+    }
+
+    // pick the variant and its parameters for this dataset
+    AutoTuner tuner;
+    tuner.seed = (unsigned)rng();
+    auto tune_start = high_resolution_clock::now();
+    MetricIndex* tuned = tuner.tune(points, n, metricType);
+    auto tune_end = high_resolution_clock::now();
+    cout<<"\nAuto-tuning ("<<duration_cast<milliseconds>(tune_end - tune_start).count()<<" milliseconds):"<<endl;
+    printTuning(tuner);
+    delete tuned;
+
+    // a demo run
+    Point q = randomQuery(rng, dist, dims);
+    cout<<"\nQuery point:"<<endl;
+    printPoint(q);
+    cout<<endl;
+
+    for(MetricIndex* index : indices){
+        index->build(points, n);
+        BuildReport report;
+        index->report(report);
+        cout<<"\n"<<index->name()<<" build report:"<<endl;
+        printReport(report);
+        if(index->stats.resampleCount) cout<<"Pivots resampled: "<<index->stats.resampleCount<<endl;
+
+        vector<Neighbor> nearest = index->knn(q, 1);
+        cout<<"Nearest neighbor:"<<endl;
+        printPoint(nearest[0].point);
+        cout<<"\nDistance = "<<nearest[0].dist<<endl;
+    }
+
+    LinearScan scan(metricType);
+    scan.build(points, n);
+    auto search_start_brute = high_resolution_clock::now();
+    vector<Neighbor> nearest = scan.knn(q, 1);
+    auto search_end_brute = high_resolution_clock::now();
+    auto totalSearchTimeBrute = duration_cast<microseconds>(search_end_brute - search_start_brute).count();
+
+    cout<<"\nActual Nearest neighbor:"<<endl;
+    printPoint(nearest[0].point);
+    cout<<"\nActual Distance = "<<nearest[0].dist<<endl;
+    cout<<"Time taken to brute force:"<<totalSearchTimeBrute<<" microseconds"<<endl;
+
+    delete []points;
+    if(!allocationFree) cout<<"\nFAILED: searching allocated"<<endl;
+    if(!balanced) cout<<"\nFAILED: resampling did not balance the splits"<<endl;
+    if(!diskSound) cout<<"\nFAILED: the disk index read too many blocks or its clones interfered"<<endl;
+    if(!joinsPay) cout<<"\nFAILED: a join made more distance computations than its baseline"<<endl;
+    return (accurate && allocationFree && balanced && diskSound && joinsPay) ? 0 : 1;
+}
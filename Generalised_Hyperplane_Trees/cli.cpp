@@ -0,0 +1,498 @@
+#include "GHT.h"
+#include "GNAT.h"
+#include "Scan.h"
+#include "PivotFilter.h"
+#include "Sharded.h"
+#include "GroundTruth.h"
+#include <chrono>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <thread>
+#include <cstring>
+using namespace std;
+using namespace chrono;
+
+// command-line front end of the indices: every setting is an option, only the dimension (D) and the capacity of a
+// single index (N_MAX) are fixed at compile time, through the GHT_DIM and GHT_N_MAX CMake cache variables
+//
+//   ght_cli build <vectors> <index file> [index options]
+//   ght_cli query <index file> <queries> [query options] [--out <file>]
+//   ght_cli bench <vectors> <queries> [index options] [query options] [--iterations <I>] [bench options]
+//
+// an index file holds the spec and the points, not the built structure: build checks the settings and reports
+// what they give, and every query rebuilds the index from the file (deterministically, from the spec's seed) before
+// answering, reporting how long that took apart from the queries
+//
+// vectors are read from .fvecs files (per row an int32 dimension then the floats) or from text, one row per line
+// with the coordinates separated by white space or commas; a row's id is its position in the file. Every row of a
+// file must have as many coordinates as its first, and queries as many as the indexed vectors
+
+#define INDEX_MAGIC 0x33584449 // "IDX3", leads an index file
+
+
+// ---------------------- Options ----------------------
+// how to build an index, everything an index file needs besides the points
+struct IndexSpec{
+    char variant[16] = "random"; // random, maxsep, mbt, gnat, scan, filter or sharded
+    char shardVariant[16] = "gnat"; // the index each shard builds, when sharded
+    int metricType = 1;
+    int leafSize = 4;
+    int splitRule = 0;
+    int layoutOrder = 0;
+    int arity = M;
+    int arityPolicy = 0;
+    int pivotPolicy = 0;
+    float maxImbalance = 1; // GHT and GNAT splits more imbalanced than this get their pivots chosen again
+    int maxResamples = 8;
+    int filterPivots = 16;
+    int shards = 4;
+    int partitionPolicy = 1;
+    unsigned seed = 1;
+    int dims = 0; // coordinates per row of the indexed vectors, queries must have as many
+};
+
+struct QuerySpec{
+    int k = 10; // 0 for a range query
+    float radius = numeric_limits<float>::infinity();
+    long long budget = -1; // distance computations per query, -1 for no limit
+    long long deadline = -1; // microseconds per query, -1 for none
+    int threads = 1;
+};
+
+static void usage(){
+    cerr<<"usage:\n"
+        <<"  ght_cli build <vectors> <index file> [index options]\n"
+        <<"  ght_cli query <index file> <queries> [query options] [--out <file>]\n"
+        <<"  ght_cli bench <vectors> <queries> [index options] [query options] [--iterations <I>] [bench options]\n"
+        <<"an index file keeps the settings and the points; query rebuilds the same index from it on every run\n"
+        <<"index options:\n"
+        <<"  --variant random|maxsep|mbt|gnat|scan|filter|sharded   (random)\n"
+        <<"  --metric l2|l1|linf             (l1)\n"
+        <<"  --leaf-size <n>                 (4)\n"
+        <<"  --split-rule 0|1|2              hyperplane, vantage point, per node (0)\n"
+        <<"  --layout 0|1|2                  pointers, breadth-first, van Emde Boas (0)\n"
+        <<"  --arity <m>                     GNAT pivots per node ("<<M<<")\n"
+        <<"  --arity-policy 0|1              GNAT fixed or adaptive arity (0)\n"
+        <<"  --pivot-policy 0|1              GNAT random or farthest-first pivots (0)\n"
+        <<"  --max-imbalance <f>             GHT and GNAT: choose a split's pivots again above this imbalance, in [0, 1] (1)\n"
+        <<"  --max-resamples <r>             GHT and GNAT: pivot choices rejected at most per split (8)\n"
+        <<"  --filter-pivots <m>             pivots of the filter (16)\n"
+        <<"  --shards <s>                    worker processes when sharded (4)\n"
+        <<"  --shard-variant <variant>       index of each shard (gnat)\n"
+        <<"  --partition 0|1                 shards by hash or by top pivot (1)\n"
+        <<"  --seed <seed>                   (1)\n"
+        <<"query options:\n"
+        <<"  --k <k>                         nearest neighbours per query, 0 with --radius for a range query (10)\n"
+        <<"  --radius <r>                    only neighbours within r\n"
+        <<"  --budget <computations>         give up on a query after this many distance computations\n"
+        <<"  --deadline <microseconds>       give up on a query after this long\n"
+        <<"  --threads <t>                   queries answered in parallel (1)\n"
+        <<"bench options:\n"
+        <<"  --truth-cache <dir>             keep the exact k nearest neighbours of the queries here between runs\n"
+        <<"  --min-recall <r>                exit with 1 when the recall falls below r\n"
+        <<"  --max-ratio <r>                 exit with 1 when the mean distance ratio to the exact answers exceeds r\n"
+        <<"points hold "<<D<<" coordinates and an index at most "<<N_MAX<<" points (sharded: per shard)"<<endl;
+}
+
+// --name value pairs after the positional arguments; throws on a name not in known
+static map<string, string> parseOptions(int argc, char* argv[], int first, const vector<string> &known){
+    map<string, string> options;
+    for(int i=first; i<argc; i+=2){
+        string name = argv[i];
+        if(name.compare(0, 2, "--")!=0 || find(known.begin(), known.end(), name.substr(2))==known.end()) throw invalid_argument("unknown option "+name);
+        if(i+1>=argc) throw invalid_argument("no value for "+name);
+        options[name.substr(2)] = argv[i+1];
+    }
+    return options;
+}
+
+static const vector<string> indexOptions = {"variant", "metric", "leaf-size", "split-rule", "layout", "arity", "arity-policy",
+    "pivot-policy", "max-imbalance", "max-resamples", "filter-pivots", "shards", "shard-variant", "partition", "seed"};
+static const vector<string> queryOptions = {"k", "radius", "budget", "deadline", "threads"};
+
+static void copyName(char out[16], const string &name){
+    if(name.size()>=16) throw invalid_argument("unknown variant "+name);
+    strcpy(out, name.c_str());
+}
+
+static IndexSpec indexSpec(map<string, string> &options){
+    IndexSpec spec;
+    if(options.count("variant")) copyName(spec.variant, options["variant"]);
+    if(options.count("shard-variant")) copyName(spec.shardVariant, options["shard-variant"]);
+    if(options.count("metric")){
+        string metric = options["metric"];
+        if(metric=="l2" || metric=="0") spec.metricType = 0;
+        else if(metric=="l1" || metric=="1") spec.metricType = 1;
+        else if(metric=="linf" || metric=="2") spec.metricType = 2;
+        else throw invalid_argument("unknown metric "+metric);
+    }
+    if(options.count("leaf-size")) spec.leafSize = stoi(options["leaf-size"]);
+    if(options.count("split-rule")) spec.splitRule = stoi(options["split-rule"]);
+    if(options.count("layout")) spec.layoutOrder = stoi(options["layout"]);
+    if(options.count("arity")) spec.arity = stoi(options["arity"]);
+    if(options.count("arity-policy")) spec.arityPolicy = stoi(options["arity-policy"]);
+    if(options.count("pivot-policy")) spec.pivotPolicy = stoi(options["pivot-policy"]);
+    if(options.count("max-imbalance")) spec.maxImbalance = stof(options["max-imbalance"]);
+    if(options.count("max-resamples")) spec.maxResamples = stoi(options["max-resamples"]);
+    if(options.count("filter-pivots")) spec.filterPivots = stoi(options["filter-pivots"]);
+    if(options.count("shards")) spec.shards = stoi(options["shards"]);
+    if(options.count("partition")) spec.partitionPolicy = stoi(options["partition"]);
+    if(options.count("seed")) spec.seed = (unsigned)stoul(options["seed"]);
+    if(spec.arity<2 || spec.arity>M_MAX) throw invalid_argument("--arity must lie in [2, "+to_string(M_MAX)+"]");
+    if(spec.leafSize<1) throw invalid_argument("--leaf-size must be positive");
+    if(spec.splitRule<0 || spec.splitRule>2) throw invalid_argument("--split-rule must be 0, 1 or 2");
+    if(spec.layoutOrder<0 || spec.layoutOrder>2) throw invalid_argument("--layout must be 0, 1 or 2");
+    if(spec.arityPolicy<0 || spec.arityPolicy>1) throw invalid_argument("--arity-policy must be 0 or 1");
+    if(spec.pivotPolicy<0 || spec.pivotPolicy>1) throw invalid_argument("--pivot-policy must be 0 or 1");
+    if(spec.partitionPolicy<0 || spec.partitionPolicy>1) throw invalid_argument("--partition must be 0 or 1");
+    if(!(spec.maxImbalance>=0 && spec.maxImbalance<=1)) throw invalid_argument("--max-imbalance must lie in [0, 1]");
+    if(spec.maxResamples<0) throw invalid_argument("--max-resamples must not be negative");
+    if(spec.filterPivots<1) throw invalid_argument("--filter-pivots must be positive");
+    if(spec.shards<1) throw invalid_argument("--shards must be positive");
+    return spec;
+}
+
+static QuerySpec querySpec(map<string, string> &options){
+    QuerySpec spec;
+    if(options.count("k")) spec.k = stoi(options["k"]);
+    if(options.count("radius")) spec.radius = stof(options["radius"]);
+    if(options.count("budget")) spec.budget = stoll(options["budget"]);
+    if(options.count("deadline")) spec.deadline = stoll(options["deadline"]);
+    if(options.count("threads")) spec.threads = max(1, stoi(options["threads"]));
+    if(spec.k<0) throw invalid_argument("--k must not be negative");
+    if(spec.k==0 && spec.radius==numeric_limits<float>::infinity()) throw invalid_argument("a range query (--k 0) needs --radius");
+    return spec;
+}
+
+// a new, unbuilt index as spec describes
+static MetricIndex* makeIndex(const IndexSpec &spec, const string &variant){
+    MetricIndex* index = nullptr;
+    if(variant=="random" || variant=="maxsep" || variant=="mbt"){
+        GHTIndex* tree;
+        if(variant=="random") tree = new RandomPivotingGHT(spec.metricType, spec.leafSize);
+        else if(variant=="maxsep") tree = new MaximumSeparationGHT(spec.metricType, spec.leafSize);
+        else tree = new ReusingPivotsMBT(spec.metricType, spec.leafSize);
+        tree->splitRule = spec.splitRule;
+        tree->layoutOrder = spec.layoutOrder;
+        tree->maxImbalance = spec.maxImbalance;
+        tree->maxResamples = spec.maxResamples;
+        index = tree;
+    }
+    else if(variant=="gnat"){
+        GNATIndex* gnat = new GNATIndex(spec.metricType, spec.leafSize);
+        gnat->arity = spec.arity;
+        gnat->arityPolicy = spec.arityPolicy;
+        gnat->pivotPolicy = spec.pivotPolicy;
+        gnat->maxImbalance = spec.maxImbalance;
+        gnat->maxResamples = spec.maxResamples;
+        index = gnat;
+    }
+    else if(variant=="scan") index = new LinearScan(spec.metricType);
+    else if(variant=="filter") index = new PivotFilter(spec.metricType, spec.filterPivots);
+    else if(variant=="sharded"){
+        if(string(spec.shardVariant)=="sharded") throw invalid_argument("a shard cannot be sharded again");
+        ShardedIndex* sharded = new ShardedIndex(makeIndex(spec, spec.shardVariant), spec.shards);
+        sharded->partitionPolicy = spec.partitionPolicy;
+        index = sharded;
+    }
+    else throw invalid_argument("unknown variant "+variant);
+    index->seed = spec.seed;
+    return index;
+}
+
+
+// ---------------------- Files ----------------------
+// fileDims is the first row's dimension, set by it and required of every later row
+static void setRow(Point &p, const float row[], int dims, int &fileDims, int id, const string &path){
+    if(fileDims==0) fileDims = dims;
+    if(dims!=fileDims) throw runtime_error(path+": row "+to_string(id)+" has "+to_string(dims)+" coordinates, the first has "+to_string(fileDims));
+    if(dims>D) throw runtime_error(path+": rows of "+to_string(dims)+" coordinates, this build holds "+to_string(D)+" (GHT_DIM)");
+    for(int j=0; j<D; j++){
+        p.coords[j] = (j<dims) ? row[j] : 0; // past dims the coordinates are 0 in every point, which leaves distances unchanged
+    }
+    p.id = id;
+}
+
+// dims is set to the coordinates per row
+static vector<Point> readVectors(const string &path, int &dims){
+    vector<Point> points;
+    ifstream in(path, ios::binary);
+    if(!in) throw runtime_error("cannot open "+path);
+    vector<float> row;
+    dims = 0;
+
+    if(path.size()>=6 && path.compare(path.size()-6, 6, ".fvecs")==0){
+        int rowDims;
+        while(in.read((char*)&rowDims, sizeof(rowDims))){
+            if(rowDims<=0 || rowDims>D) throw runtime_error(path+": bad row at "+to_string(points.size()));
+            row.resize(rowDims);
+            if(!in.read((char*)row.data(), rowDims*sizeof(float))) throw runtime_error(path+": truncated row at "+to_string(points.size()));
+            points.emplace_back();
+            setRow(points.back(), row.data(), rowDims, dims, (int)points.size()-1, path);
+        }
+        return points;
+    }
+
+    string line, field;
+    for(int lineNo=1; getline(in, line); lineNo++){
+        replace(line.begin(), line.end(), ',', ' ');
+        istringstream fields(line);
+        row.clear();
+        while(fields>>field){
+            char* end;
+            float value = strtof(field.c_str(), &end);
+            if(end==field.c_str() || *end!='\0') throw runtime_error(path+": line "+to_string(lineNo)+": not a number: "+field);
+            row.push_back(value);
+        }
+        if(row.empty()) continue; // blank lines
+        points.emplace_back();
+        setRow(points.back(), row.data(), (int)row.size(), dims, (int)points.size()-1, path);
+    }
+    return points;
+}
+
+static void checkQueryDims(const vector<Point> &queries, int dims, int indexDims, const string &path){
+    if(!queries.empty() && dims!=indexDims) throw runtime_error(path+": queries of "+to_string(dims)+" coordinates, the index holds vectors of "+to_string(indexDims));
+}
+
+// an index file holds the spec and the points; every build draws its random choices from the spec's seed, so
+// building over them again gives back the same index
+static void writeIndex(const string &path, const IndexSpec &spec, const vector<Point> &points){
+    ofstream out(path, ios::binary);
+    int header[3] = {INDEX_MAGIC, D, (int)points.size()};
+    out.write((const char*)header, sizeof(header));
+    out.write((const char*)&spec, sizeof(spec));
+    out.write((const char*)points.data(), points.size()*sizeof(Point));
+    if(!out) throw runtime_error("cannot write "+path);
+}
+
+static IndexSpec readIndex(const string &path, vector<Point> &points){
+    ifstream in(path, ios::binary);
+    if(!in) throw runtime_error("cannot open "+path);
+    int header[3];
+    IndexSpec spec;
+    in.read((char*)header, sizeof(header));
+    in.read((char*)&spec, sizeof(spec));
+    if(!in || header[0]!=INDEX_MAGIC) throw runtime_error(path+" is not an index file");
+    if(header[1]!=D) throw runtime_error(path+" holds points of "+to_string(header[1])+" coordinates, this build holds "+to_string(D));
+    // the count must match what follows the header, before anything is sized by it
+    streamoff start = in.tellg();
+    in.seekg(0, ios::end);
+    streamoff rest = in.tellg()-start;
+    in.seekg(start);
+    if(header[2]<0 || rest!=(streamoff)header[2]*(streamoff)sizeof(Point)) throw runtime_error(path+" is truncated or corrupt");
+    points.resize(header[2]);
+    if(!in.read((char*)points.data(), points.size()*sizeof(Point))) throw runtime_error(path+" is truncated");
+    return spec;
+}
+
+
+// ---------------------- Queries ----------------------
+// answers queries[0..count) into results, split between spec.threads threads; latency[i] is query i's in microseconds
+static void answer(const MetricIndex &index, const vector<Point> &queries, const QuerySpec &spec, vector<ResultSet> &results, vector<double> &latency){
+    int count = (int)queries.size();
+    results.resize(count);
+    latency.resize(count);
+    auto work = [&](int t){
+        for(int i=t; i<count; i+=spec.threads){
+            auto start = high_resolution_clock::now();
+            results[i].reset(spec.k, spec.radius, spec.budget);
+            if(spec.deadline>=0) results[i].expireAfter(spec.deadline);
+            index.search(queries[i], results[i]);
+            latency[i] = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count()/1000.0;
+        }
+    };
+    vector<thread> threads;
+    for(int t=1; t<spec.threads; t++) threads.emplace_back(work, t);
+    work(0);
+    for(thread &t : threads) t.join();
+}
+
+static double percentile(vector<double> values, double p){
+    if(values.empty()) return 0;
+    sort(values.begin(), values.end());
+    return values[min((int)values.size()-1, (int)(p*values.size()))];
+}
+
+// one line per query: its position, then id:distance for every neighbour, nearest first
+static void printResults(ostream &out, const vector<ResultSet> &results){
+    out<<fixed<<setprecision(6);
+    for(int i=0; i<(int)results.size(); i++){
+        out<<i;
+        for(const Neighbor &neighbor : results[i].sorted()) out<<" "<<neighbor.point.id<<":"<<neighbor.dist;
+        out<<"\n";
+    }
+}
+
+// fraction of the exact answer's neighbours found, over the queries with a non-empty exact answer
+static double recall(const vector<ResultSet> &found, const vector<ResultSet> &exact){
+    double sum = 0;
+    int counted = 0;
+    for(int i=0; i<(int)found.size(); i++){
+        vector<Neighbor> truth = exact[i].sorted();
+        if(truth.empty()) continue;
+        vector<int> ids;
+        for(const Neighbor &neighbor : found[i].sorted()) ids.push_back(neighbor.point.id);
+        int hits = 0;
+        for(const Neighbor &neighbor : truth){
+            if(find(ids.begin(), ids.end(), neighbor.point.id)!=ids.end()) hits++;
+        }
+        sum += (double)hits/truth.size();
+        counted++;
+    }
+    return counted ? sum/counted : 1;
+}
+
+
+// ---------------------- Subcommands ----------------------
+static MetricIndex* buildIndex(const IndexSpec &spec, const vector<Point> &points, double &micros){
+    MetricIndex* index = makeIndex(spec, spec.variant);
+    auto start = high_resolution_clock::now();
+    try{
+        index->build(points.data(), (int)points.size());
+    }
+    catch(...){
+        delete index;
+        throw;
+    }
+    micros = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count()/1000.0;
+    return index;
+}
+
+static void printBuild(const MetricIndex &index, double micros){
+    cout<<fixed<<setprecision(2);
+    cout<<index.name()<<" over "<<index.stats.pointCount<<" points: built in "<<micros/1000<<" ms, "<<index.stats.computationsBuild
+        <<" distance computations, "<<index.stats.pivotCount<<" pivots, "<<(index.stats.memoryBytes/1024.0)<<" KB held"<<endl;
+}
+
+static int buildCommand(int argc, char* argv[]){
+    if(argc<4) throw invalid_argument("build needs a vector file and an index file");
+    map<string, string> options = parseOptions(argc, argv, 4, indexOptions);
+    IndexSpec spec = indexSpec(options);
+    vector<Point> points = readVectors(argv[2], spec.dims);
+    double micros;
+    unique_ptr<MetricIndex> index(buildIndex(spec, points, micros));
+    printBuild(*index, micros);
+    BuildReport report;
+    index->report(report);
+    printReport(report);
+    writeIndex(argv[3], spec, points);
+    return 0;
+}
+
+static int queryCommand(int argc, char* argv[]){
+    if(argc<4) throw invalid_argument("query needs an index file and a query file");
+    vector<string> known = queryOptions;
+    known.push_back("out");
+    map<string, string> options = parseOptions(argc, argv, 4, known);
+    QuerySpec querySettings = querySpec(options);
+    vector<Point> points;
+    IndexSpec spec = readIndex(argv[2], points);
+    int dims;
+    vector<Point> queries = readVectors(argv[3], dims);
+    checkQueryDims(queries, dims, spec.dims, argv[3]);
+    double micros;
+    unique_ptr<MetricIndex> index(buildIndex(spec, points, micros));
+    cerr<<fixed<<setprecision(2)<<"rebuilt "<<index->name()<<" over "<<points.size()<<" points in "<<micros/1000<<" ms"<<endl;
+
+    vector<ResultSet> results;
+    vector<double> latency;
+    auto start = high_resolution_clock::now();
+    answer(*index, queries, querySettings, results, latency);
+    double total = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count()/1000.0;
+    if(options.count("out")){
+        ofstream out(options["out"]);
+        if(!out) throw runtime_error("cannot write "+options["out"]);
+        printResults(out, results);
+    }
+    else printResults(cout, results);
+    cerr<<fixed<<setprecision(2)<<queries.size()<<" queries in "<<total/1000<<" ms, "<<(queries.size()/(total/1e6))<<" queries per second"<<endl;
+    return 0;
+}
+
+// the exact answers come from a linear scan, the recall is of the index's answers against them; k nearest neighbour
+// queries without a radius are checked against the ground truth, which also gives the distance ratio
+static int benchCommand(int argc, char* argv[]){
+    if(argc<4) throw invalid_argument("bench needs a vector file and a query file");
+    vector<string> known = indexOptions;
+    known.insert(known.end(), queryOptions.begin(), queryOptions.end());
+    known.insert(known.end(), {"iterations", "truth-cache", "min-recall", "max-ratio"});
+    map<string, string> options = parseOptions(argc, argv, 4, known);
+    IndexSpec spec = indexSpec(options);
+    QuerySpec querySettings = querySpec(options);
+    int iterations = options.count("iterations") ? max(1, stoi(options["iterations"])) : 1;
+    AccuracyFloor floor = {0, numeric_limits<double>::infinity()};
+    if(options.count("min-recall")) floor.minRecall = stod(options["min-recall"]);
+    if(options.count("max-ratio")) floor.maxRatio = stod(options["max-ratio"]);
+    vector<Point> points = readVectors(argv[2], spec.dims);
+    int dims;
+    vector<Point> queries = readVectors(argv[3], dims);
+    checkQueryDims(queries, dims, spec.dims, argv[3]);
+
+    double micros;
+    unique_ptr<MetricIndex> index(buildIndex(spec, points, micros));
+    printBuild(*index, micros);
+
+    vector<ResultSet> results, exact;
+    vector<double> latency, allLatency;
+    double total = 0;
+    for(int iter=0; iter<iterations; iter++){
+        auto start = high_resolution_clock::now();
+        answer(*index, queries, querySettings, results, latency);
+        total += duration_cast<nanoseconds>(high_resolution_clock::now() - start).count()/1000.0;
+        allLatency.insert(allLatency.end(), latency.begin(), latency.end());
+    }
+    long long computations = 0;
+    for(const ResultSet &result : results) computations += result.computations;
+
+    Accuracy accuracy;
+    if(querySettings.k>0 && querySettings.radius==numeric_limits<float>::infinity()){
+        GroundTruth truth = groundTruth(points.data(), (int)points.size(), queries.data(), (int)queries.size(), querySettings.k,
+            spec.metricType, options.count("truth-cache") ? options["truth-cache"] : "");
+        accuracy = measureAccuracy(truth, results.data(), (int)results.size());
+    }
+    else{
+        LinearScan scan(spec.metricType);
+        scan.build(points.data(), (int)points.size());
+        QuerySpec exactSettings = querySettings;
+        exactSettings.budget = exactSettings.deadline = -1;
+        answer(scan, queries, exactSettings, exact, latency);
+        accuracy.recall = recall(results, exact);
+        accuracy.distanceRatio = accuracy.worstRatio = 1; // a range answer holds no point past the radius, so only its recall can fall short
+    }
+
+    long long answered = (long long)queries.size()*iterations;
+    cout<<answered<<" queries ("<<queries.size()<<" x "<<iterations<<") on "<<querySettings.threads<<" threads: "
+        <<(answered/(total/1e6))<<" queries per second"<<endl;
+    cout<<"Latency p50 "<<percentile(allLatency, 0.5)<<", p99 "<<percentile(allLatency, 0.99)<<", max "<<percentile(allLatency, 1)<<" microseconds"<<endl;
+    cout<<"Distance computations per query: "<<(queries.empty() ? 0 : (double)computations/queries.size())<<endl;
+    bool passed = checkAccuracy("Accuracy against the exact answers", accuracy, floor);
+    return passed ? 0 : 1;
+}
+
+int main(int argc, char* argv[]){
+    if(argc<2){
+        usage();
+        return 1;
+    }
+    string command = argv[1];
+    try{
+        if(command=="build") return buildCommand(argc, argv);
+        if(command=="query") return queryCommand(argc, argv);
+        if(command=="bench") return benchCommand(argc, argv);
+        usage();
+        return 1;
+    }
+    catch(const invalid_argument &e){
+        cerr<<"ght_cli: "<<e.what()<<endl;
+        usage();
+        return 1;
+    }
+    catch(const exception &e){
+        cerr<<"ght_cli: "<<e.what()<<endl;
+        return 1;
+    }
+}
@@ -1,13 +1,16 @@
 #include <iostream>
 #include <random>
 #include <iomanip>
+#include <cstdlib>
 using namespace std;
 
 #define N_MAX 200
 #define D_MAX 10
 
-int main() {
-    mt19937 rng((unsigned)time(0));
+// the seed is the first argument, 1 by default, so a dataset can always be generated again
+int main(int argc, char* argv[]) {
+    unsigned seed = (argc > 1) ? (unsigned)strtoul(argv[1], nullptr, 10) : 1;
+    mt19937 rng(seed);
     uniform_real_distribution<float> dist(-10.0f, 10.0f);
 
     cout << "#pragma once\n";
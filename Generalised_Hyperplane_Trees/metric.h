@@ -0,0 +1,57 @@
+#pragma once
+#include <iostream>
+#include <cmath>
+#include <iomanip> // set precision to 2
+
+#ifndef D
+#define D 50 // dimension of data
+#endif
+#ifndef N_MAX
+#define N_MAX 2000 // most points a single index can hold
+#endif
+
+
+// ---------------------- Structures ----------------------
+struct Point{
+    float coords[D];
+    int id; // set by the caller (e.g. position in the dataset) and unique within an index, handed back with search results
+};
+
+
+// ---------------------- Distance ----------------------
+// 0 - L2 distance
+// 1 - L1 distance
+// 2 - L_inf distance
+inline float distance(const Point &x, const Point &y, int metricType){
+    float d = 0;
+    if(metricType==0){ // L2 distance
+        for(int i=0; i<D; i++){
+            float diff = x.coords[i]-y.coords[i];
+            d += diff*diff;
+        }
+        return sqrtf(d);
+    }
+    else if(metricType==1){ // L1 distance
+        for(int i=0; i<D; i++){
+            float diff = fabsf(x.coords[i]-y.coords[i]);
+            d += diff;
+        }
+        return d;
+    }
+    else{ // L_inf distance
+        for(int i=0; i<D; i++){
+            float diff = fabsf(x.coords[i]-y.coords[i]);
+            d = (diff>d) ? diff : d;
+        }
+        return d;
+    }
+}
+
+inline void printPoint(const Point &p){
+    std::cout<<"("<<std::fixed<<std::setprecision(2);
+    for(int i=0; i<D; i++){
+        std::cout<<p.coords[i];
+        if(i<D-1) std::cout<<", ";
+    }
+    std::cout<<")";
+}
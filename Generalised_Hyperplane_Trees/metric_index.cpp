@@ -0,0 +1,111 @@
+#include "metric_index.h"
+#include <algorithm>
+using namespace std;
+
+
+// ---------------------- Results ----------------------
+static bool nearer(const Neighbor &a, const Neighbor &b){
+    return a.dist<b.dist;
+}
+
+bool ResultSet::contains(int id) const{
+    for(const Neighbor &item : items){
+        if(item.point.id==id) return true;
+    }
+    return false;
+}
+
+void ResultSet::offer(const Point &p, float d){
+    if(k==0){ // range query
+        if(d<=radius && !(distinct && contains(p.id))) items.push_back({p, d});
+        return;
+    }
+    if((int)items.size()<k){
+        if(d>radius || (distinct && contains(p.id))) return;
+        items.push_back({p, d});
+        push_heap(items.begin(), items.end(), nearer);
+    }
+    else if(d<items.front().dist && !(distinct && contains(p.id))){ // replace the current k-th nearest
+        pop_heap(items.begin(), items.end(), nearer);
+        items.back() = {p, d};
+        push_heap(items.begin(), items.end(), nearer);
+    }
+}
+
+vector<Neighbor> ResultSet::sorted() const{
+    vector<Neighbor> out = items;
+    sort(out.begin(), out.end(), nearer);
+    return out;
+}
+
+
+// ---------------------- Build Report ----------------------
+void BuildReport::addLeaf(int depth, int points, long long bytes){
+    int level = min(depth, MAX_DEPTH-1);
+    nodes++;
+    leaves++;
+    maxDepth = max(maxDepth, depth);
+    memoryBytes += bytes;
+    leavesAtDepth[level]++;
+    leafOccupancy[points]++;
+}
+
+void BuildReport::addSplit(int depth, int fanOut, int pivotsStored, float imbalance, long long bytes){
+    int level = min(depth, MAX_DEPTH-1);
+    nodes++;
+    pivots += pivotsStored;
+    maxDepth = max(maxDepth, depth);
+    memoryBytes += bytes;
+    splitsAtDepth[level]++;
+    fanOutSum[level] += fanOut;
+    imbalanceSum[level] += imbalance;
+    imbalanceMax[level] = max(imbalanceMax[level], imbalance);
+}
+
+void printReport(const BuildReport &report){
+    cout<<fixed<<setprecision(2);
+    cout<<"Nodes: "<<report.nodes<<" ("<<report.leaves<<" leaves), max depth: "<<report.maxDepth<<endl;
+    cout<<"Pivots stored: "<<report.pivots<<endl;
+    cout<<"Memory: "<<(report.memoryBytes/1024.0)<<" KB"<<endl;
+
+    cout<<"Leaves per depth:"<<endl;
+    for(int d=0; d<MAX_DEPTH; d++){
+        if(report.leavesAtDepth[d]) cout<<"  "<<d<<(d==MAX_DEPTH-1 ? "+" : "")<<": "<<report.leavesAtDepth[d]<<endl;
+    }
+    cout<<"Leaf occupancy (points: leaves):"<<endl;
+    for(int k=0; k<=N_MAX; k++){
+        if(report.leafOccupancy[k]) cout<<"  "<<k<<": "<<report.leafOccupancy[k]<<endl;
+    }
+    cout<<"Fan-out and split imbalance per level (mean fan-out, mean / max imbalance):"<<endl;
+    for(int d=0; d<MAX_DEPTH; d++){
+        if(report.splitsAtDepth[d]){
+            cout<<"  "<<d<<(d==MAX_DEPTH-1 ? "+" : "")<<": "<<((double)report.fanOutSum[d]/report.splitsAtDepth[d])<<", "
+                <<(report.imbalanceSum[d]/report.splitsAtDepth[d])<<" / "<<report.imbalanceMax[d]<<endl;
+        }
+    }
+}
+
+
+// ---------------------- Index ----------------------
+vector<Neighbor> MetricIndex::knn(const Point &q, int k){
+    ResultSet result(k);
+    search(q, result);
+    stats.computationsSearch += result.computations;
+    return result.sorted();
+}
+
+vector<Neighbor> MetricIndex::range(const Point &q, float r){
+    ResultSet result(0, r);
+    search(q, result);
+    stats.computationsSearch += result.computations;
+    return result.sorted();
+}
+
+void MetricIndex::merge(const MetricIndex &other){
+    vector<Point> all;
+    collect(all);
+    other.collect(all);
+    long long computations = stats.computationsBuild;
+    build(all.data(), (int)all.size());
+    stats.computationsBuild += computations;
+}
@@ -0,0 +1,275 @@
+#pragma once
+#include "metric.h"
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <chrono>
+
+#define MAX_DEPTH 64 // depths beyond this are lumped together in the build report
+#define DEADLINE_STRIDE 16 // calls to ResultSet::exhausted between readings of the clock
+
+
+// ---------------------- Results ----------------------
+struct Neighbor{
+    Point point;
+    float dist;
+};
+
+// collects the answer to one query while an index is searched
+// k>0  - the k nearest neighbours within radius, kept as a max-heap on dist
+// k==0 - every point within radius
+// bound() is the radius the trees prune with, it plays the part bestDist plays in a 1-NN search
+// reuse one ResultSet across queries (reset keeps its storage) to search without touching the allocator
+// a search cut short by the budget or the deadline still returns what it found; the subtrees it had no time for are
+// recorded through leaveOut, and the true k-th nearest distance then lies in [lowerBound(), bound()]
+class ResultSet{
+public:
+    long long computations = 0; // distance computations spent on this query
+    long long budget = -1; // computations allowed before the search gives up, -1 for no limit
+    bool distinct = false; // drop points whose id is already in the result, for searches that can meet a point twice
+    // every point the search skipped for want of budget or time is at least this far from q, infinity when none was
+    float unexplored = std::numeric_limits<float>::infinity();
+
+    ResultSet(int k=1, float radius=std::numeric_limits<float>::infinity(), long long budget=-1){
+        reset(k, radius, budget);
+    }
+
+    void reset(int k, float radius=std::numeric_limits<float>::infinity(), long long budget=-1){
+        this->k = k;
+        this->radius = radius;
+        this->budget = budget;
+        computations = 0;
+        unexplored = std::numeric_limits<float>::infinity();
+        timed = late = false;
+        items.clear();
+        if(k>0) items.reserve(k);
+    }
+
+    float bound() const{
+        if(k>0 && (int)items.size()==k) return items.front().dist;
+        return radius;
+    }
+
+    void offer(const Point &p, float d);
+
+    // the search gives up at the given time, or microseconds from now; reset clears the deadline
+    void expireAt(std::chrono::steady_clock::time_point when){
+        deadline = when;
+        timed = true;
+        late = false;
+        ticks = 0;
+    }
+    void expireAfter(long long microseconds){
+        expireAt(std::chrono::steady_clock::now()+std::chrono::microseconds(microseconds));
+    }
+    bool hasDeadline() const{
+        return timed;
+    }
+    std::chrono::steady_clock::time_point expiry() const{
+        return deadline;
+    }
+
+    // the clock is read once every DEADLINE_STRIDE calls, about as often as a leaf is scanned, so a deadline costs
+    // next to nothing and is overrun by at most that many distance computations
+    bool exhausted() const{
+        if(budget>=0 && computations>=budget) return true;
+        if(!timed) return false;
+        if(!late && ++ticks>=DEADLINE_STRIDE){
+            ticks = 0;
+            late = std::chrono::steady_clock::now()>=deadline;
+        }
+        return late;
+    }
+
+    // a subtree the search had no budget or time left for, no point in it is nearer to q than lowerBound
+    void leaveOut(float lowerBound){
+        if(lowerBound<unexplored) unexplored = lowerBound;
+    }
+
+    // the true k-th nearest distance (with k==0, that of the nearest point within radius not found) is at least this;
+    // equal to bound() when the search was not cut short
+    float lowerBound() const{
+        return std::min(unexplored, bound());
+    }
+
+    int size() const{
+        return (int)items.size();
+    }
+
+    // k, 0 for a range query
+    int wanted() const{
+        return k;
+    }
+
+    // the results found so far, nearest first
+    std::vector<Neighbor> sorted() const;
+
+private:
+    int k;
+    float radius;
+    std::vector<Neighbor> items;
+    std::chrono::steady_clock::time_point deadline;
+    bool timed = false;
+    mutable bool late = false; // the deadline has passed
+    mutable int ticks = 0; // calls to exhausted since the clock was last read
+
+    bool contains(int id) const;
+};
+
+
+// ---------------------- Statistics ----------------------
+struct IndexStats{
+    int pointCount = 0; // points in the index
+    long long computationsBuild = 0; // distance computations in building the index
+    long long computationsSearch = 0; // distance computations in searching, summed over the queries made through knn/range
+    int pivotCount = 0; // pivots in the index
+    int resampleCount = 0; // pivot choices rejected for producing an imbalanced split
+    long long memoryBytes = 0; // held by the index once built, nodes and their points
+    long long peakBuildBytes = 0; // most held at once by the last build or merge, the index so far plus scratch
+};
+
+// shape of a built tree, filled by MetricIndex::report
+// a split's imbalance is (largest-smallest child)/(points in all children), |leftN-rightN|/(leftN+rightN) for a GHT node
+struct BuildReport{
+    int nodes = 0;
+    int leaves = 0;
+    int pivots = 0;
+    int maxDepth = 0;
+    int leavesAtDepth[MAX_DEPTH] = {}; // depth histogram of the leaves
+    int leafOccupancy[N_MAX+1] = {}; // leafOccupancy[k] = no of leaves holding k points
+    int splitsAtDepth[MAX_DEPTH] = {};
+    long long fanOutSum[MAX_DEPTH] = {}; // summed arity of the internal nodes of each level
+    double imbalanceSum[MAX_DEPTH] = {};
+    float imbalanceMax[MAX_DEPTH] = {};
+    long long memoryBytes = 0;
+
+    void addLeaf(int depth, int points, long long bytes);
+    void addSplit(int depth, int fanOut, int pivotsStored, float imbalance, long long bytes);
+};
+
+void printReport(const BuildReport &report);
+
+
+// ---------------------- Memory ----------------------
+// bytes held by an index while it builds, counted where it allocates: the nodes made so far and the scratch in use
+// charge comes before the allocation, so a build that would go over budget stops before it does
+class MemoryMeter{
+public:
+    long long budget = -1; // -1 for no limit
+    long long live = 0;
+    long long peak = 0;
+
+    void charge(long long bytes){
+        if(budget>=0 && live+bytes>budget) throw std::length_error("MemoryMeter: memory budget exceeded");
+        live += bytes;
+        if(live>peak) peak = live;
+    }
+
+    void release(long long bytes){
+        live -= bytes;
+    }
+};
+
+// bytes charged to a meter for the scope of the guard, scratch that is freed on every way out of the scope
+class MemoryCharge{
+public:
+    MemoryCharge(MemoryMeter &meter, long long bytes) : meter(meter), bytes(bytes){
+        meter.charge(bytes);
+    }
+    MemoryCharge(const MemoryCharge&) = delete;
+    MemoryCharge& operator=(const MemoryCharge&) = delete;
+    ~MemoryCharge(){
+        meter.release(bytes);
+    }
+
+private:
+    MemoryMeter &meter;
+    long long bytes;
+};
+
+
+// ---------------------- Randomness ----------------------
+// splitmix64, the generator every build draws its random choices from
+// its state is one word, so a build can cheaply split off a generator of its own for each subtree; the tree then
+// depends only on the seed, not on the order or the threads its subtrees are built in
+class SplitRng{
+public:
+    using result_type = unsigned long long;
+
+    explicit SplitRng(unsigned long long seed=1) : state(seed) {}
+
+    unsigned long long operator()(){
+        unsigned long long z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z^(z>>30))*0xbf58476d1ce4e5b9ULL;
+        z = (z^(z>>27))*0x94d049bb133111ebULL;
+        return z^(z>>31);
+    }
+
+    // uniform in [0, n)
+    int below(int n){
+        return (int)((*this)()%(unsigned long long)n);
+    }
+
+    // an independent generator for a subtree
+    SplitRng split(){
+        return SplitRng((*this)());
+    }
+
+    static constexpr unsigned long long min(){
+        return 0;
+    }
+    static constexpr unsigned long long max(){
+        return ~0ULL;
+    }
+
+private:
+    unsigned long long state;
+};
+
+
+// ---------------------- Index ----------------------
+// common interface of the tree variants, so a caller can build and query any of them the same way
+class MetricIndex{
+public:
+    int metricType;
+    int leafSize; // partitioning stops once a partition has at most this many points
+    unsigned seed = 1; // of the generator build draws its random choices from, equal seeds give equal indices
+    // bytes a GHT or GNAT build may hold at once, index and scratch together, -1 for no limit; a build that would
+    // need more throws length_error and leaves the index empty, a merge throws having added only some of the points
+    long long memoryBudget = -1;
+    IndexStats stats;
+
+    MetricIndex(int metricType, int leafSize) : metricType(metricType), leafSize(leafSize) {}
+    virtual ~MetricIndex() {}
+
+    virtual const char* name() const = 0;
+
+    // (re)builds the index over copies of arr[0..n), resetting stats
+    virtual void build(const Point arr[], int n) = 0;
+
+    // explores the index for q, offering candidates to result and counting into result.computations
+    // does not modify the index, so concurrent searches with separate ResultSets are safe
+    virtual void search(const Point &q, ResultSet &result) const = 0;
+
+    // adds the shape of the index to report
+    virtual void report(BuildReport &report) const = 0;
+
+    // a deep copy of the index, built or not, with its settings and stats
+    virtual MetricIndex* clone() const = 0;
+
+    // appends copies of the indexed points to out
+    virtual void collect(std::vector<Point> &out) const = 0;
+
+    // adds the points of other, which must use the same metric and hold ids not already in this index
+    // the default rebuilds over the points of both; stats.computationsBuild accumulates instead of restarting
+    virtual void merge(const MetricIndex &other);
+
+    std::vector<Neighbor> knn(const Point &q, int k);
+    std::vector<Neighbor> range(const Point &q, float r);
+
+protected:
+    float distance(const Point &x, const Point &y) const{
+        return ::distance(x, y, metricType);
+    }
+};